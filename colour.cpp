@@ -0,0 +1,18 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "colour.h"
+
+/// @brief RGB components for every hue at full brightness, generated at compile time
+const uint8_t hueTable[COLOUR_MAX_HUE + 1][3] PROGMEM = {
+  HUE_TABLE_32(0)
+  HUE_TABLE_32(COLOUR_RESOLUTION)
+  HUE_TABLE_32(COLOUR_RESOLUTION * 2)
+  HUE_TABLE_32(COLOUR_RESOLUTION * 3)
+  HUE_TABLE_32(COLOUR_RESOLUTION * 4)
+  HUE_TABLE_32(COLOUR_RESOLUTION * 5)
+};
@@ -0,0 +1,89 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Lamp colour calculation from hue
+
+#ifndef COLOUR_H
+#define COLOUR_H
+
+#include "hal.h"
+
+/// @defgroup colour Colour
+/// @brief Conversion of the lamp's hue to RGB components
+///
+/// RGB components for every hue are generated at compile time and stored in the flash
+/// memory, conversion is a single table lookup
+///
+/// This module does not depend on hardware and can be compiled for the host
+///
+/// @{
+
+#define COLOUR_RESOLUTION 32                                   ///< Hue resolution per primary colour
+#define COLOUR_MAX_HUE (COLOUR_RESOLUTION * 6 - 1)             ///< Maximum hue value
+#define COLOUR_MAX 256                                         ///< Full brightness of any RGB component
+#define COLOUR_OFF 0                                           ///< RGB component is off
+#define COLOUR_FACTOR (COLOUR_MAX/COLOUR_RESOLUTION)           ///< Scale factor to obtain RGB components suitable for neopixels
+#define COLOUR_RAMPDOWN(val,max) ((max - val) * COLOUR_FACTOR) ///< Linear ramp-up of rgb component
+#define COLOUR_RAMPUP(val,min) ((val - min) * COLOUR_FACTOR)   ///< Linear ramp-down of rgb component
+#define COLOUR_CLAMP(val) (((val) > 255) ? 255 : (val))        ///< Limit rgb component to the range suitable for neopixels
+#define COLOUR_BRIGHTNESS_SHIFT 6                              ///< Brightness resolution in bits
+#define COLOUR_MAX_BRIGHTNESS (1 << COLOUR_BRIGHTNESS_SHIFT)   ///< Max value for brightness
+
+/// @brief Red component for the hue in range 0..COLOUR_MAX_HUE at full brightness
+#define HUE_TABLE_RED(hue) COLOUR_CLAMP( \
+  ((hue) < COLOUR_RESOLUTION * 2) ? COLOUR_MAX : \
+  ((hue) < COLOUR_RESOLUTION * 3) ? COLOUR_RAMPDOWN((hue), COLOUR_RESOLUTION * 3) : \
+  ((hue) < COLOUR_RESOLUTION * 5) ? COLOUR_OFF : \
+  COLOUR_RAMPUP((hue), COLOUR_RESOLUTION * 5))
+/// @brief Green component for the hue in range 0..COLOUR_MAX_HUE at full brightness
+#define HUE_TABLE_GREEN(hue) COLOUR_CLAMP( \
+  ((hue) < COLOUR_RESOLUTION) ? COLOUR_OFF : \
+  ((hue) < COLOUR_RESOLUTION * 2) ? COLOUR_RAMPUP((hue), COLOUR_RESOLUTION) : \
+  ((hue) < COLOUR_RESOLUTION * 4) ? COLOUR_MAX : \
+  ((hue) < COLOUR_RESOLUTION * 5) ? COLOUR_RAMPDOWN((hue), COLOUR_RESOLUTION * 5) : \
+  COLOUR_OFF)
+/// @brief Blue component for the hue in range 0..COLOUR_MAX_HUE at full brightness
+#define HUE_TABLE_BLUE(hue) COLOUR_CLAMP( \
+  ((hue) < COLOUR_RESOLUTION) ? COLOUR_RAMPDOWN((hue), COLOUR_RESOLUTION) : \
+  ((hue) < COLOUR_RESOLUTION * 3) ? COLOUR_OFF : \
+  ((hue) < COLOUR_RESOLUTION * 4) ? COLOUR_RAMPUP((hue), COLOUR_RESOLUTION * 3) : \
+  COLOUR_MAX)
+
+#define HUE_TABLE_ENTRY(hue) { HUE_TABLE_RED(hue), HUE_TABLE_GREEN(hue), HUE_TABLE_BLUE(hue) },         ///< Hue table entry
+#define HUE_TABLE_4(hue) HUE_TABLE_ENTRY(hue) HUE_TABLE_ENTRY((hue) + 1) HUE_TABLE_ENTRY((hue) + 2) HUE_TABLE_ENTRY((hue) + 3) ///< 4 hue table entries
+#define HUE_TABLE_16(hue) HUE_TABLE_4(hue) HUE_TABLE_4((hue) + 4) HUE_TABLE_4((hue) + 8) HUE_TABLE_4((hue) + 12)             ///< 16 hue table entries
+#define HUE_TABLE_32(hue) HUE_TABLE_16(hue) HUE_TABLE_16((hue) + 16)                                                         ///< 32 hue table entries
+
+inline void colourFromHue(uint8_t hue, uint8_t & red, uint8_t & green, uint8_t & blue);
+
+/// @}
+
+#if COLOUR_RESOLUTION != 32
+#error "Hue table is generated for COLOUR_RESOLUTION of 32"
+#endif
+
+extern const uint8_t hueTable[COLOUR_MAX_HUE + 1][3] PROGMEM;
+
+//////////////////////////////////////////////////////////////////////
+// Colour inline functions
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Calculates RGB components at full brightness from hue
+/// @param hue Hue value in range 0..COLOUR_MAX_HUE
+/// @param red Receives red component
+/// @param green Receives green component
+/// @param blue Receives blue component
+void colourFromHue(uint8_t hue, uint8_t & red, uint8_t & green, uint8_t & blue) {
+  if (hue >= COLOUR_MAX_HUE) hue = 0;
+  const uint8_t * rgb = hueTable[hue];
+  red = pgm_read_byte(&rgb[0]);
+  green = pgm_read_byte(&rgb[1]);
+  blue = pgm_read_byte(&rgb[2]);
+}
+
+#endif // #ifndef COLOUR_H
@@ -0,0 +1,136 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Single colour per matrix column, generates neopixel colours while they are sent
+
+#ifndef COLUMNFRAME_H
+#define COLUMNFRAME_H
+
+#include "hal.h"
+
+#include "hardware.h"
+#include "matrix.h"
+
+/// @defgroup column_frame Column Frame
+/// @brief Frame which stores a single colour per column of the neopixel matrix
+///
+/// Provides ColumnFrame class template which is used instead of the neopixel frame buffer
+/// if HW_NEOPIXEL_STREAMING is defined
+///
+/// @{
+
+/// @brief Keeps a single colour for every column of the matrix
+///
+/// Accepts the same setPixel() calls as Neopixel, so effects render into ColumnFrame without
+/// changes; the neopixel sets the colour of its whole column. Only images whose colour is the
+/// same along each column (uniform colour, directional light, rainbow) are kept exactly
+///
+/// ColumnFrame is the generator for Neopixel::stream(): prepare() converts every column to
+/// output bytes once per frame, before the transmission starts, so that pixel() called
+/// between two neopixels is only a column lookup
+///
+/// @tparam cols Columns in neopixel matrix
+template <uint8_t cols>
+class ColumnFrame {
+  public:
+    ColumnFrame();
+    inline void setPixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+    inline void setUniformColour(uint8_t r, uint8_t g, uint8_t b);
+    inline bool takeChanges(void);
+  public:
+    template <class Output> inline void prepare(Output & neopixel);
+    inline const uint8_t * pixel(uint8_t index);
+  private:
+    static const uint8_t bytesPerPixel = 3;   ///< Output bytes per column
+  private:
+    uint8_t red[cols];      ///< Red component of each column
+    uint8_t green[cols];    ///< Green component of each column
+    uint8_t blue[cols];     ///< Blue component of each column
+    uint8_t output[cols * bytesPerPixel];  ///< Output bytes of each column, set by prepare()
+    bool changed;           ///< True if any column changed since the previous takeChanges()
+};
+
+/// @}
+
+//////////////////////////////////////////////////////////////////////
+// ColumnFrame inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises all columns to black, marked as changed so that the first frame is always sent
+template <uint8_t cols>
+ColumnFrame<cols>::ColumnFrame() {
+  memset(red, 0, sizeof(red));
+  memset(green, 0, sizeof(green));
+  memset(blue, 0, sizeof(blue));
+  memset(output, 0, sizeof(output));
+  changed = true;
+}
+
+/// @brief Sets colour of the column which contains the neopixel
+/// @param index Index of the neopixel, range 0..HW_NEOPIXEL_NUMBER-1
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+template <uint8_t cols>
+void ColumnFrame<cols>::setPixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+  if (index >= HW_NEOPIXEL_NUMBER) return;
+  uint8_t x = matrixColumn(index);
+  if ((red[x] == r) && (green[x] == g) && (blue[x] == b)) return;
+  red[x] = r;
+  green[x] = g;
+  blue[x] = b;
+  changed = true;
+}
+
+/// @brief Sets all columns to the same colour
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+template <uint8_t cols>
+void ColumnFrame<cols>::setUniformColour(uint8_t r, uint8_t g, uint8_t b) {
+  for (uint8_t x = 0; x < cols; x++) {
+    if ((red[x] == r) && (green[x] == g) && (blue[x] == b)) continue;
+    red[x] = r;
+    green[x] = g;
+    blue[x] = b;
+    changed = true;
+  }
+}
+
+/// @brief Checks whether any column changed since the previous call
+/// @return True if the frame needs to be sent to the neopixels
+template <uint8_t cols>
+bool ColumnFrame<cols>::takeChanges(void) {
+  bool result = changed;
+  changed = false;
+  return (result);
+}
+
+/// @brief Converts colours of all columns to output bytes, called by Neopixel::stream()
+///
+/// Called once per frame before the transmission starts; global brightness and gamma
+/// correction are applied here rather than between the neopixels
+///
+/// @tparam Output Neopixel or other class providing outputPixel(r, g, b, pixel)
+/// @param neopixel Neopixels which convert the colours
+template <uint8_t cols>
+template <class Output>
+void ColumnFrame<cols>::prepare(Output & neopixel) {
+  for (uint8_t x = 0; x < cols; x++)
+    neopixel.outputPixel(red[x], green[x], blue[x], &output[x * bytesPerPixel]);
+}
+
+/// @brief Returns output bytes of the neopixel, called by Neopixel::stream()
+/// @param index Index of the neopixel, range 0..HW_NEOPIXEL_NUMBER-1
+/// @return Output bytes of the neopixel's column, set by the latest prepare()
+template <uint8_t cols>
+const uint8_t * ColumnFrame<cols>::pixel(uint8_t index) {
+  return (&output[matrixColumn(index) * bytesPerPixel]);
+}
+
+#endif // #ifndef COLUMNFRAME_H
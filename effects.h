@@ -0,0 +1,307 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Animated effects for the neopixel matrix
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "hal.h"
+
+#include "hardware.h"
+#include "hsv.h"
+#include "matrix.h"
+
+/// @defgroup effects Animated effects
+/// @brief Animated effects rendered over the neopixel matrix
+///
+/// Each effect is a class template specialised by the matrix geometry (rows and columns)
+/// and provides the following methods, no virtual methods are used:
+/// * step() advances the effect's animation by one frame
+/// * render() writes the current state of the effect into neopixel frame buffer; any
+/// output class which provides setPixel(index, r, g, b) may be used instead of Neopixel,
+/// e.g. to run effects on the host
+///
+/// Both methods are called from the frame scheduler once per frame; all calculations
+/// are 8-bit or 16-bit fixed-point without divisions
+///
+/// Effects address neopixels by their position in the matrix (y * cols + x), positions
+/// are mapped to neopixel indexes with matrixIndex(); rows and cols must match the layout
+/// in hardware.h
+///
+/// @{
+
+inline uint8_t effectRandom(void);
+inline uint8_t effectRandom(uint8_t range);
+inline uint8_t effectScale(uint8_t input, uint8_t scale);
+
+/// @brief Rainbow scrolling across the matrix columns
+/// @tparam rows Rows in neopixel matrix
+/// @tparam cols Columns in neopixel matrix
+template <uint8_t rows, uint8_t cols>
+class RainbowEffect {
+  public:
+    RainbowEffect() : hueOffset(0) {}
+    inline void step(void);
+    template <class Output> inline void render(Output & neopixel);
+  private:
+    /// Hue difference between adjacent columns, a single column has no neighbours and does not need a step
+    static const uint8_t hueStep = (cols > 1) ? (256 / cols) : 0;
+    uint8_t hueOffset;                          ///< Hue of the first column
+};
+
+/// @brief All neopixels smoothly fade in and out with the same colour
+/// @tparam rows Rows in neopixel matrix
+/// @tparam cols Columns in neopixel matrix
+template <uint8_t rows, uint8_t cols>
+class BreathingEffect {
+  public:
+    BreathingEffect() : phase(0), red(0), green(0), blue(0) {}
+    inline void setColour(uint8_t r, uint8_t g, uint8_t b);
+    inline void step(void);
+    template <class Output> inline void render(Output & neopixel);
+  private:
+    static const uint8_t minLevel = 64;    ///< Minimum brightness level during the breathing cycle
+    uint8_t phase;                         ///< Position within the breathing cycle
+    uint8_t red;                           ///< Red component of the colour
+    uint8_t green;                         ///< Green component of the colour
+    uint8_t blue;                          ///< Blue component of the colour
+};
+
+/// @brief Fire simulation, the heat rises along each column
+///
+/// Row 0 (y = 0) is the bottom of the column
+///
+/// @tparam rows Rows in neopixel matrix
+/// @tparam cols Columns in neopixel matrix
+template <uint8_t rows, uint8_t cols>
+class FireEffect {
+  public:
+    FireEffect() : frameCount(0) {
+      memset(heat, 0, sizeof(heat));
+    }
+    inline void step(void);
+    template <class Output> inline void render(Output & neopixel);
+  private:
+    static const uint8_t framesPerStep = (HW_SCHEDULER_FRAME_RATE + 29) / 30; ///< Fire is animated at ~30 steps per second
+    static const uint8_t cooling = 0x1f;      ///< Maximum heat lost by each cell per step (mask of random value)
+    static const uint8_t sparking = 120;      ///< Chance of a new spark in each column per step, range 0..255
+    static const uint8_t sparkRows = 2;       ///< Sparks appear in this number of bottom rows
+    static const uint8_t sparkMinHeat = 160;  ///< Minimum heat of a new spark
+    uint8_t heat[rows * cols];                ///< Heat of each cell, indexed by position in the matrix
+    uint8_t frameCount;                       ///< Frames since the last step
+};
+
+/// @brief Random neopixels flash with the same colour and slowly fade out
+/// @tparam rows Rows in neopixel matrix
+/// @tparam cols Columns in neopixel matrix
+template <uint8_t rows, uint8_t cols>
+class TwinkleEffect {
+  public:
+    TwinkleEffect() : red(0), green(0), blue(0) {
+      memset(level, 0, sizeof(level));
+    }
+    inline void setColour(uint8_t r, uint8_t g, uint8_t b);
+    inline void step(void);
+    template <class Output> inline void render(Output & neopixel);
+  private:
+    static const uint8_t fadeShift = 4;       ///< Each step brightness level is decreased by 1/2^fadeShift
+    static const uint8_t twinkling = 40;      ///< Chance of a new flash per step, range 0..255
+    uint8_t level[rows * cols];               ///< Brightness level of each neopixel, indexed by position in the matrix
+    uint8_t red;                              ///< Red component of the colour
+    uint8_t green;                            ///< Green component of the colour
+    uint8_t blue;                             ///< Blue component of the colour
+};
+
+/// @}
+
+//////////////////////////////////////////////////////////////////////
+// Effects' inline functions
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Fast pseudo-random number generator for effects (16-bit xorshift)
+/// @return Pseudo-random number, range 0..255
+uint8_t effectRandom(void) {
+  static uint16_t state = 0xace1;
+  state ^= state << 7;
+  state ^= state >> 9;
+  state ^= state << 8;
+  return (state);
+}
+
+/// @brief Fast pseudo-random number generator for effects (16-bit xorshift)
+/// @param range Upper limit of the generated number
+/// @return Pseudo-random number, range 0..range-1
+uint8_t effectRandom(uint8_t range) {
+  return (((uint16_t)effectRandom() * range) >> 8);
+}
+
+/// @brief Scales 8-bit value by 8-bit fraction
+/// @param input Value to scale, range 0..255
+/// @param scale Scale factor, range 0..255
+/// @return Scaled value
+uint8_t effectScale(uint8_t input, uint8_t scale) {
+  return (((uint16_t)input * (scale + 1)) >> 8);
+}
+
+//////////////////////////////////////////////////////////////////////
+// RainbowEffect inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Advances the effect by one frame
+template <uint8_t rows, uint8_t cols>
+void RainbowEffect<rows, cols>::step(void) {
+  hueOffset++;
+}
+
+/// @brief Writes the current state of the effect into neopixel frame buffer
+/// @tparam Output Neopixel or other class providing setPixel(index, r, g, b)
+/// @param neopixel Neopixel array to render to
+template <uint8_t rows, uint8_t cols>
+template <class Output>
+void RainbowEffect<rows, cols>::render(Output & neopixel) {
+  uint8_t red[cols], green[cols], blue[cols];
+  HsvColour colour = {hueOffset, 255, 255};
+  for (uint8_t x = 0; x < cols; x++) {
+    hsvToRgb(colour, red[x], green[x], blue[x]);
+    colour.hue += hueStep;
+  }
+  uint8_t position = 0;
+  for (uint8_t y = 0; y < rows; y++) {
+    for (uint8_t x = 0; x < cols; x++)
+      neopixel.setPixel(matrixIndex(position++), red[x], green[x], blue[x]);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// BreathingEffect inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Sets colour of the effect
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+template <uint8_t rows, uint8_t cols>
+void BreathingEffect<rows, cols>::setColour(uint8_t r, uint8_t g, uint8_t b) {
+  HalAtomicState oldSREG = halAtomicBegin();
+  red = r;
+  green = g;
+  blue = b;
+  halAtomicEnd(oldSREG);
+}
+
+/// @brief Advances the effect by one frame
+template <uint8_t rows, uint8_t cols>
+void BreathingEffect<rows, cols>::step(void) {
+  phase++;
+}
+
+/// @brief Writes the current state of the effect into neopixel frame buffer
+/// @tparam Output Neopixel or other class providing setPixel(index, r, g, b)
+/// @param neopixel Neopixel array to render to
+template <uint8_t rows, uint8_t cols>
+template <class Output>
+void BreathingEffect<rows, cols>::render(Output & neopixel) {
+  // Triangle wave from phase, range 0..254
+  uint8_t triangle = (phase & 0x80) ? ((uint8_t)~phase << 1) : (phase << 1);
+  uint8_t level = minLevel + effectScale(triangle, 255 - minLevel);
+  uint8_t r = effectScale(red, level);
+  uint8_t g = effectScale(green, level);
+  uint8_t b = effectScale(blue, level);
+  for (uint8_t i = 0; i < rows * cols; i++)
+    neopixel.setPixel(i, r, g, b);
+}
+
+//////////////////////////////////////////////////////////////////////
+// FireEffect inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Advances the effect by one frame
+template <uint8_t rows, uint8_t cols>
+void FireEffect<rows, cols>::step(void) {
+  if (++frameCount < framesPerStep) return;
+  frameCount = 0;
+  // Every cell cools down a little
+  for (uint8_t i = 0; i < rows * cols; i++) {
+    uint8_t loss = effectRandom() & cooling;
+    heat[i] = (heat[i] > loss) ? (heat[i] - loss) : 0;
+  }
+  for (uint8_t x = 0; x < cols; x++) {
+    uint8_t * column = &heat[x];
+    // Heat rises and diffuses, (a + 2 * b) / 3 is approximated as (a + 2 * b) * 85 / 256
+    for (uint8_t y = rows - 1; y >= 2; y--)
+      column[y * cols] = ((uint16_t)column[(y - 1) * cols] + column[(y - 2) * cols] + column[(y - 2) * cols]) * 85 >> 8;
+    // New sparks appear at the bottom
+    if (effectRandom() < sparking) {
+      uint8_t y = effectRandom(sparkRows);
+      uint16_t newHeat = column[y * cols] + sparkMinHeat + effectRandom(255 - sparkMinHeat);
+      column[y * cols] = (newHeat > 255) ? 255 : newHeat;
+    }
+  }
+}
+
+/// @brief Writes the current state of the effect into neopixel frame buffer
+///
+/// Heat is converted to colour from black through red and yellow to white
+///
+/// @tparam Output Neopixel or other class providing setPixel(index, r, g, b)
+/// @param neopixel Neopixel array to render to
+template <uint8_t rows, uint8_t cols>
+template <class Output>
+void FireEffect<rows, cols>::render(Output & neopixel) {
+  for (uint8_t i = 0; i < rows * cols; i++) {
+    // Heat is scaled to 0..191 and split into three ranges of 64
+    uint8_t scaledHeat = effectScale(heat[i], 191);
+    uint8_t ramp = (scaledHeat & 0x3f) << 2;
+    uint8_t index = matrixIndex(i);
+    if (scaledHeat & 0x80)
+      neopixel.setPixel(index, 255, 255, ramp);
+    else if (scaledHeat & 0x40)
+      neopixel.setPixel(index, 255, ramp, 0);
+    else
+      neopixel.setPixel(index, ramp, 0, 0);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+// TwinkleEffect inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Sets colour of the effect
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+template <uint8_t rows, uint8_t cols>
+void TwinkleEffect<rows, cols>::setColour(uint8_t r, uint8_t g, uint8_t b) {
+  HalAtomicState oldSREG = halAtomicBegin();
+  red = r;
+  green = g;
+  blue = b;
+  halAtomicEnd(oldSREG);
+}
+
+/// @brief Advances the effect by one frame
+template <uint8_t rows, uint8_t cols>
+void TwinkleEffect<rows, cols>::step(void) {
+  for (uint8_t i = 0; i < rows * cols; i++)
+    level[i] -= ((level[i] >> fadeShift) | (level[i] ? 1 : 0));
+  if (effectRandom() < twinkling)
+    level[effectRandom(rows * cols)] = 255;
+}
+
+/// @brief Writes the current state of the effect into neopixel frame buffer
+/// @tparam Output Neopixel or other class providing setPixel(index, r, g, b)
+/// @param neopixel Neopixel array to render to
+template <uint8_t rows, uint8_t cols>
+template <class Output>
+void TwinkleEffect<rows, cols>::render(Output & neopixel) {
+  for (uint8_t i = 0; i < rows * cols; i++)
+    neopixel.setPixel(matrixIndex(i), effectScale(red, level[i]), effectScale(green, level[i]), effectScale(blue, level[i]));
+}
+
+#endif // #ifndef EFFECTS_H
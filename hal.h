@@ -0,0 +1,105 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Thin hardware abstraction for the hardware-independent modules
+
+#ifndef HAL_H
+#define HAL_H
+
+/// @defgroup hal Hardware Abstraction
+/// @brief The only Arduino / AVR dependencies of the hardware-independent code
+///
+/// Colour conversion, effects, matrix layout, transitions, ring buffer, quadrature
+/// decoding and rotary encoder logic include this header instead of Arduino.h; they only
+/// use fixed-width integer types, bit macros, flash tables and short atomic sections
+///
+/// When compiled for Arduino, this header includes Arduino.h and maps the atomic
+/// section to SREG save / restore (processor state register on ESP8266). Tables which
+/// are read by interrupt handlers are declared HAL_ISR_PROGMEM instead of PROGMEM and functions
+/// which are called by interrupt handlers are declared HAL_ISR_CODE. When ARDUINO
+/// is not defined (e.g. host build of the hardware-independent code), flash tables are
+/// ordinary constant arrays and atomic sections do nothing
+///
+/// @{
+
+#if defined(ARDUINO) && defined(ARDUINO_ARCH_ESP8266)
+
+#include <Arduino.h>
+
+/// Tables read by interrupt handlers are kept in RAM: flash is not accessible while it is
+/// written (e.g. EEPROM.commit()) and interrupts stay enabled meanwhile
+#define HAL_ISR_PROGMEM
+#define HAL_ISR_CODE ICACHE_RAM_ATTR  ///< Functions called by interrupt handlers are kept in RAM as well
+
+typedef uint32_t HalAtomicState;   ///< Interrupt state saved by halAtomicBegin(), processor state register
+
+/// @brief Begins atomic section by raising interrupt level
+/// @return Interrupt state to be passed to halAtomicEnd()
+inline HalAtomicState halAtomicBegin(void) {
+  return (xt_rsil(15));
+}
+
+/// @brief Ends atomic section by restoring interrupt state
+/// @param oldSREG Value returned by halAtomicBegin()
+inline void halAtomicEnd(HalAtomicState oldSREG) {
+  xt_wsr_ps(oldSREG);
+}
+
+#elif defined(ARDUINO)
+
+#include <Arduino.h>
+
+#define HAL_ISR_PROGMEM PROGMEM   ///< Tables read by interrupt handlers are kept in flash
+#define HAL_ISR_CODE              ///< Functions called by interrupt handlers need no attribute
+
+typedef uint8_t HalAtomicState;    ///< Interrupt state saved by halAtomicBegin(), SREG
+
+/// @brief Begins atomic section by disabling interrupts
+/// @return Interrupt state to be passed to halAtomicEnd()
+inline HalAtomicState halAtomicBegin(void) {
+  uint8_t oldSREG = SREG;
+  noInterrupts();
+  return (oldSREG);
+}
+
+/// @brief Ends atomic section by restoring interrupt state
+/// @param oldSREG Value returned by halAtomicBegin()
+inline void halAtomicEnd(HalAtomicState oldSREG) {
+  SREG = oldSREG;
+}
+
+#else
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM                                                   ///< Flash tables are ordinary constant arrays
+#define pgm_read_byte(address) (*(const uint8_t *)(address))      ///< Reads byte from a flash table
+#define pgm_read_word(address) (*(const uint16_t *)(address))     ///< Reads word from a flash table
+#define HAL_ISR_PROGMEM                                           ///< Tables read by interrupt handlers
+#define HAL_ISR_CODE                                              ///< Functions called by interrupt handlers
+#define _BV(bit) (1 << (bit))                                     ///< Bit mask of the bit number
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)           ///< Reads a bit of the value
+
+typedef uint8_t HalAtomicState;    ///< Dummy interrupt state
+
+/// @brief Begins atomic section, no interrupts to disable
+/// @return Dummy interrupt state
+inline HalAtomicState halAtomicBegin(void) {
+  return (0);
+}
+
+/// @brief Ends atomic section
+inline void halAtomicEnd(HalAtomicState) {
+}
+
+#endif
+
+/// @}
+
+#endif // #ifndef HAL_H
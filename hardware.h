@@ -13,35 +13,163 @@
 #ifndef HARDWARE_H
 #define HARDWARE_H
 
-// @addtogroup neopixel
+/// @defgroup hw_profile Hardware profiles
+/// @brief Pin and peripheral layouts of the supported MCUs
+///
+/// Profile is selected automatically from the target MCU:
+/// * ATmega328 (Arduino Nano / Uno), used if no other profile matches
+/// * ATtiny85 (HW_PROFILE_ATTINY85), must be clocked at 16 MHz from the internal PLL;
+/// neopixels are rendered without frame buffer (see HW_NEOPIXEL_STREAMING), telemetry and
+/// SPI neopixel backend are not available since ATtiny85 has neither USART nor SPI
+/// * ESP8266 (HW_PROFILE_ESP8266), neopixels are driven by UART1 and frames may be
+/// received over WiFi (see HW_NETWORK); telemetry is not available, lamp state is kept in
+/// the flash-emulated EEPROM
+/// @{
+
+#if defined(__AVR_ATtiny85__)
+#define HW_PROFILE_ATTINY85   ///< Defined if compiled for ATtiny85
+#elif defined(ARDUINO_ARCH_ESP8266)
+#define HW_PROFILE_ESP8266    ///< Defined if compiled for ESP8266
+#endif
+
+/// @}
+///
+/// @addtogroup neopixel
 /// @{
 
+#define HW_NEOPIXEL_BACKEND_BITBANG 0   ///< Neopixel data are bit-banged by CPU to HW_NEOPIXEL_PORT / HW_NEOPIXEL_BIT
+#define HW_NEOPIXEL_BACKEND_SPI     1   ///< Neopixel data are encoded as SPI symbols and shifted out by hardware SPI via MOSI pin
+#define HW_NEOPIXEL_BACKEND_UART    2   ///< Neopixel data are encoded as UART symbols and shifted out by UART1 TX pin (ESP8266 only)
+
+#ifdef HW_PROFILE_ESP8266
+#define HW_NEOPIXEL_BACKEND HW_NEOPIXEL_BACKEND_UART    ///< Neopixel output backend, UART is timed by hardware so WiFi interrupts do not corrupt the frame
+#else
+#define HW_NEOPIXEL_BACKEND HW_NEOPIXEL_BACKEND_BITBANG ///< Neopixel output backend, HW_NEOPIXEL_BACKEND_BITBANG or HW_NEOPIXEL_BACKEND_SPI
+#endif
+
 #define HW_NEOPIXEL_PORT  PORTB  ///< Neopixels' pin output port
 #define HW_NEOPIXEL_DIR   DDRB   ///< Neopixels' pin direction port
+#ifdef HW_PROFILE_ATTINY85
+#define HW_NEOPIXEL_BIT   0      ///< Neopixels' pin in the port (0 corresponds to PB0, pin 5 on ATtiny85)
+#else
 #define HW_NEOPIXEL_BIT   5      ///< Neopixels' pin in the port (5 corresponds to D13 on Nano/Uno)
+#endif
+
+#define HW_NEOPIXEL_SPI_DIR       DDRB  ///< SPI pins' direction port
+#define HW_NEOPIXEL_SPI_MOSI_BIT  3     ///< SPI MOSI pin in the port, neopixels' data line with SPI backend (3 corresponds to D11 on Nano/Uno)
+#define HW_NEOPIXEL_SPI_SCK_BIT   5     ///< SPI SCK pin in the port (5 corresponds to D13 on Nano/Uno)
+#define HW_NEOPIXEL_SPI_SS_BIT    2     ///< SPI SS pin in the port, must be output for SPI master (2 corresponds to D10 on Nano/Uno)
+
+/// @brief UART baud rate with UART backend, 4 UART bits per neopixel bit and 2 neopixel bits per 6N1 UART frame
+///
+/// UART1 TX is GPIO2 (D4 on NodeMCU / Wemos D1 mini)
+#define HW_NEOPIXEL_UART_BAUD (4 * (NS_PER_SEC / HW_NEOPIXEL_TBIT))
+
+/// @brief If defined, neopixels are split into HW_NEOPIXEL_PARALLEL_STRIPS chains which are sent at the same time
+///
+/// Chains are connected to consecutive bits of HW_NEOPIXEL_PARALLEL_PORT; neopixel indexes are
+/// assigned to the chains in blocks of HW_NEOPIXEL_NUMBER / HW_NEOPIXEL_PARALLEL_STRIPS, see ParallelNeopixel.
+/// Temporal dithering is not available with parallel chains
+//#define HW_NEOPIXEL_PARALLEL
+
+#define HW_NEOPIXEL_PARALLEL_PORT       PORTC   ///< Parallel chains' pins output port
+#define HW_NEOPIXEL_PARALLEL_DIR        DDRC    ///< Parallel chains' pins direction port
+#define HW_NEOPIXEL_PARALLEL_FIRST_BIT  0       ///< Pin of the first chain in the port (0 corresponds to A0 on Nano/Uno)
+#define HW_NEOPIXEL_PARALLEL_STRIPS     4       ///< Number of parallel chains, range 1..8
 
 #define HW_NEOPIXEL_ROWS  8      ///< Rows in neopixel matrix
 #define HW_NEOPIXEL_COLS  4      ///< Columns in neopixel matrix
 
 #define HW_NEOPIXEL_NUMBER (HW_NEOPIXEL_ROWS * HW_NEOPIXEL_COLS)   ///< Total number of neopixels
 
+#define HW_NEOPIXEL_LAYOUT_COLUMNS            0   ///< Neopixels are chained column by column, each column starts at row 0
+#define HW_NEOPIXEL_LAYOUT_ROWS               1   ///< Neopixels are chained row by row, each row starts at column 0
+#define HW_NEOPIXEL_LAYOUT_COLUMNS_SERPENTINE 2   ///< Neopixels are chained column by column, odd columns run in reverse
+#define HW_NEOPIXEL_LAYOUT_ROWS_SERPENTINE    3   ///< Neopixels are chained row by row, odd rows run in reverse
+
+#define HW_NEOPIXEL_LAYOUT HW_NEOPIXEL_LAYOUT_COLUMNS   ///< Wiring of the neopixel matrix
+
+/// @brief If defined, neopixels have no frame buffer and the colours are generated while the frame is sent
+///
+/// Colour of each neopixel is calculated just before it is sent (see Neopixel::stream()),
+/// thus RAM use does not depend on the number of neopixels; only effects whose colour
+/// is the same along each column are available
+#ifdef HW_PROFILE_ATTINY85
+#define HW_NEOPIXEL_STREAMING
+#endif
+
 /// @}
 ///
 /// @defgroup neopixel_timings Neopixel timing macros
 /// @ingroup neopixel
 /// @brief Timing constraints taken mostly from the WS2812 datasheets
 ///
-/// These timings are chosen to be conservative and avoid problems rather than for maximum throughput
+/// These timings are chosen to keep the bit period close to 1.25 us (800 kHz), the only
+/// parameters which actually matter are the widths of high pulses, low parts of the bits
+/// are elastic as long as they do not exceed reset time
 /// @{
 
-#define HW_NEOPIXEL_T1H  900    ///< Width of a 1 bit in ns
-#define HW_NEOPIXEL_T1L  600    ///< Width of a 1 bit in ns
-
-#define HW_NEOPIXEL_T0H  400    ///< Width of a 0 bit in ns
-#define HW_NEOPIXEL_T0L  900    ///< Width of a 0 bit in ns
+#define HW_NEOPIXEL_T0H  350    ///< Width of the high part of a 0 bit in ns
+#define HW_NEOPIXEL_T1H  800    ///< Width of the high part of a 1 bit in ns
+#define HW_NEOPIXEL_TBIT 1250   ///< Total width of a bit (both 0 and 1) in ns
 
 #define HW_NEOPIXEL_RES  6000   ///< Width of the low gap between bits to cause a frame to latch (in ns)
 
+/// @brief If defined, interrupts are briefly enabled between neopixels while the frame is sent
+///
+/// Interrupt sources whose handlers do not fit into the gap are masked for the whole frame
+/// (see TransmitInterruptMask): scheduler tick, Timer0 overflow (millis()) and telemetry
+/// transmit. Their flags stay set and they are serviced right after the frame
+///
+/// Handlers serviced in the gap:
+/// * Pin Change (rotary encoders): RotEncSampler::interruptHandler() only queues the port
+/// snapshot, about 70 CPU cycles including interrupt response and return; the snapshots
+/// are decoded by the scheduler tick after the frame, so every line change is kept
+/// * telemetry receive (USART_RX_vect), about 34 CPU cycles
+///
+/// Each of them together with the gap's own code (about 20 cycles, see Neopixel::stream())
+/// stays below HW_NEOPIXEL_RES (96 cycles at 16 MHz); the frame may only be latched early
+/// if a telemetry byte and an encoder line change arrive while the same neopixel is sent.
+/// On ATtiny85 there is no telemetry
+///
+/// Not used on ESP8266: UART backend does not disable interrupts
+///
+/// @warning Any interrupt source enabled in addition to these must be masked by
+/// TransmitInterruptMask or have a handler which fits into the gap, otherwise the frame
+/// is latched prematurely. With HW_PROFILER the probe in the Pin Change ISR adds its own
+/// cycles, so frames may be latched early while profiling; tools/telemetry_decode.py
+/// checks the measured cycles of the ISR against the gap
+#ifndef HW_PROFILE_ESP8266
+#define HW_NEOPIXEL_INTERRUPT_WINDOW
+#endif
+
+/// @brief If defined, gamma correction is applied to colour components and brightness on output
+#define HW_NEOPIXEL_GAMMA
+
+/// @brief If defined, temporal dithering is used to display colour components with more than 8-bit resolution
+///
+/// Requires 2 additional bytes of RAM per colour component; Neopixel::update() must be
+/// called on every frame (see HW_SCHEDULER_FRAME_RATE) to keep dithering going.
+/// Not available without frame buffer or with parallel chains (ParallelNeopixel keeps the
+/// frame as bit planes and has no dithering pass)
+#if !defined(HW_NEOPIXEL_STREAMING) && !defined(HW_NEOPIXEL_PARALLEL)
+#define HW_NEOPIXEL_DITHER
+#endif
+
+/// @brief If defined, global brightness is reduced when estimated neopixel current exceeds HW_NEOPIXEL_POWER_BUDGET
+///
+/// Current is estimated from the sum of colour components sent to the neopixels, so hue is
+/// taken into account (white draws three times the current of a primary colour); the sum is
+/// updated whenever a neopixel is set and no extra pass over the frame buffer is made.
+/// Not available without frame buffer or with parallel chains
+#if !defined(HW_NEOPIXEL_STREAMING) && !defined(HW_NEOPIXEL_PARALLEL)
+#define HW_NEOPIXEL_POWER_LIMIT
+#endif
+
+#define HW_NEOPIXEL_POWER_BUDGET     1500   ///< Current available to the neopixels (mA), power supply rating less the MCU and margin
+#define HW_NEOPIXEL_CHANNEL_CURRENT  20     ///< Current of a single colour component of a neopixel at full brightness (mA)
+#define HW_NEOPIXEL_IDLE_CURRENT     1      ///< Current of a neopixel which is dark (mA)
+
 #define NS_PER_SEC (1000000000L)                      ///< Nanoseconds per second. Note that this has to be SIGNED since we want to be able to check for negative values of derivatives
 #define CYCLES_PER_SEC (F_CPU)                        ///< CPU cycles per second
 #define NS_PER_CYCLE ( NS_PER_SEC / CYCLES_PER_SEC )  ///< CPU nanoseconds per cycle
@@ -52,27 +180,132 @@
 /// @addtogroup rot_enc_control
 /// @{
 
-#define HW_ROTENC_PORT    PIND    ///< Rotary encoder pins' input port
-#define HW_ROTENC_DIR     DDRD    ///< Rotary encoder pins' direction port
-#define HW_ROTENC_OUT     PORTD   ///< Rotary encoder pins' output port (only to enable pullup)
+#if defined(HW_PROFILE_ESP8266)
+
+#define HW_ROTENC_PORT      GpioPort<12>  ///< Rotary encoder pins' port traits, see ports.h (bit 0 corresponds to GPIO12)
+
+#define HW_ROTENC_A_BIT     0     ///< Line A bit in the port (0 corresponds to GPIO12, D6 on NodeMCU / Wemos D1 mini)
+#define HW_ROTENC_B_BIT     1     ///< Line B bit in the port (1 corresponds to GPIO13, D7 on NodeMCU / Wemos D1 mini)
+#define HW_ROTENC_BTN_BIT   2     ///< Rotary encoder button bit in the port (2 corresponds to GPIO14, D5 on NodeMCU / Wemos D1 mini)
+
+#define HW_ROTENC_BRIGHTNESS                        ///< If defined, brightness is controlled by the second rotary encoder
+#define HW_ROTENC_BRIGHTNESS_PORT     GpioPort<0>   ///< Brightness encoder pins' port traits (bit 0 corresponds to GPIO0)
+#define HW_ROTENC_BRIGHTNESS_A_BIT    4     ///< Brightness encoder line A bit in the port (4 corresponds to GPIO4, D2 on NodeMCU / Wemos D1 mini)
+#define HW_ROTENC_BRIGHTNESS_B_BIT    5     ///< Brightness encoder line B bit in the port (5 corresponds to GPIO5, D1 on NodeMCU / Wemos D1 mini)
+#define HW_ROTENC_BRIGHTNESS_BTN_BIT  0     ///< Brightness encoder button bit in the port (0 corresponds to GPIO0, D3 on NodeMCU / Wemos D1 mini, must not be held at reset)
+
+#elif defined(HW_PROFILE_ATTINY85)
+
+#define HW_ROTENC_PORT      PortB   ///< Rotary encoder pins' port traits, see ports.h
+
+#define HW_ROTENC_A_BIT     3     ///< Line A bit in the port (3 corresponds to PB3, pin 2 on ATtiny85)
+#define HW_ROTENC_B_BIT     4     ///< Line B bit in the port (4 corresponds to PB4, pin 3 on ATtiny85)
+#define HW_ROTENC_BTN_BIT   2     ///< Rotary encoder button bit in the port (2 corresponds to PB2, pin 7 on ATtiny85)
+
+#define HW_ROTENC_INTVECT   PCINT0_vect   ///< Rotary encoder Pin Change Interrupt vector
+
+// ATtiny85 has no pins left for the second rotary encoder, brightness is selected by long click
+
+#else
+
+#define HW_ROTENC_PORT      PortD   ///< Rotary encoder pins' port traits, see ports.h
 
 #define HW_ROTENC_A_BIT     2     ///< Line A bit in the port (2 corresponds to D2 on Nano/Uno)
 #define HW_ROTENC_B_BIT     3     ///< Line B bit in the port (3 corresponds to D3 on Nano/Uno)
 #define HW_ROTENC_BTN_BIT   4     ///< Rotary encoder button bit in the port (4 corresponds to D4 on Nano/Uno)
 
-#define HW_ROTENC_INTVECT PCINT2_vect   ///< Rotary encoder Pin Change Interrupt vector
-#define HW_ROTENC_PCMSK   PCMSK2        ///< Rotary encoder Pin Change Interrupt PCMSK register
-#define HW_ROTENC_PCIFR   PCIF2         ///< Rotary encoder Pin Change Interrupt PCIFR bit
-#define HW_ROTENC_PCICR   PCIE2         ///< Rotary encoder Pin Change Interrupt PCICR bit
+#define HW_ROTENC_BRIGHTNESS                    ///< If defined, brightness is controlled by the second rotary encoder
+#define HW_ROTENC_BRIGHTNESS_PORT     PortD     ///< Brightness encoder pins' port traits, must be HW_ROTENC_PORT to share its sampler and HW_ROTENC_INTVECT
+#define HW_ROTENC_BRIGHTNESS_A_BIT    5     ///< Brightness encoder line A bit in the port (5 corresponds to D5 on Nano/Uno)
+#define HW_ROTENC_BRIGHTNESS_B_BIT    6     ///< Brightness encoder line B bit in the port (6 corresponds to D6 on Nano/Uno)
+#define HW_ROTENC_BRIGHTNESS_BTN_BIT  7     ///< Brightness encoder button bit in the port (7 corresponds to D7 on Nano/Uno)
+
+#define HW_ROTENC_INTVECT   PCINT2_vect   ///< Rotary encoders' Pin Change Interrupt vector
 
-#define HW_ROTENC_A_INT     PCINT18   ///< Line A Pin Change Interrupt
-#define HW_ROTENC_B_INT     PCINT19   ///< Line B Pin Change Interrupt
-#define HW_ROTENC_BTN_INT   PCINT20   ///< Rotary encoder button Pin Change Interrupt
+#endif
 
 #define HW_ROTENC_CYCLES_PER_DETENT 4   ///< Full pulse cycles per rotary encoder detent (click), set to 1 if encoder has no detents
 
+#define HW_ROTENC_ACCELERATION              ///< Comment out to disable rotary encoder acceleration
+#define HW_ROTENC_ACCEL_FAST_TIME   15000   ///< Detents closer than this (microseconds) are multiplied by HW_ROTENC_ACCEL_FAST_MULT
+#define HW_ROTENC_ACCEL_FAST_MULT   8       ///< Counter step multiplier for fast rotation
+#define HW_ROTENC_ACCEL_SLOW_TIME   40000   ///< Detents closer than this (microseconds) are multiplied by HW_ROTENC_ACCEL_SLOW_MULT
+#define HW_ROTENC_ACCEL_SLOW_MULT   3       ///< Counter step multiplier for moderate rotation
+
 #define HW_BUTTON_SHORT_CLICK_MIN_TIME  20    ///< Rotary encoder button short click timings (milliseconds)
 #define HW_BUTTON_LONG_CLICK_MIN_TIME   500   ///< Rotary encoder button long click timings (milliseconds)
+#define HW_BUTTON_DEBOUNCE_TIME         5     ///< Rotary encoder button must be stable for this time to register press or release (milliseconds)
+#define HW_BUTTON_DOUBLE_CLICK_TIME     250   ///< Second click within this time after release is a double click, 0 disables double click (milliseconds)
+#define HW_BUTTON_HOLD_REPEAT_TIME      750   ///< Hold-repeat period after long click while button is held (milliseconds)
+
+/// @}
+///
+/// @addtogroup scheduler
+/// @{
+
+#define HW_SCHEDULER_INTVECT    TIMER1_COMPA_vect   ///< Scheduler tick interrupt vector
+
+#ifdef HW_PROFILE_ESP8266
+#define HW_SCHEDULER_TIMER1_CLOCK (80000000L / 16)   ///< ESP8266 timer1 clock, APB clock divided by 16 (TIM_DIV16)
+#endif
+
+#ifdef HW_PROFILE_ATTINY85
+#define HW_SCHEDULER_TIMER1_PRESCALER 64                                ///< ATtiny85 Timer1 is 8-bit and needs prescaler to reach tick period
+#define HW_SCHEDULER_TIMER1_CS (_BV(CS12) | _BV(CS11) | _BV(CS10))     ///< ATtiny85 Timer1 clock select bits for HW_SCHEDULER_TIMER1_PRESCALER
+#endif
+
+#define HW_SCHEDULER_TICK_RATE  1000    ///< Scheduler ticks per second
+#define HW_SCHEDULER_FRAME_RATE 100     ///< Frames per second, higher rate reduces dithering flicker
+
+/// @}
+///
+/// @addtogroup telemetry
+/// @{
+
+#define HW_TELEMETRY_LEVEL_OFF    0   ///< No telemetry, serial port is not used
+#define HW_TELEMETRY_LEVEL_ERROR  1   ///< Only errors are reported
+#define HW_TELEMETRY_LEVEL_INFO   2   ///< Errors and lamp state changes are reported
+#define HW_TELEMETRY_LEVEL_DEBUG  3   ///< All records are reported
+
+#if defined(HW_PROFILE_ATTINY85) || defined(HW_PROFILE_ESP8266)
+#define HW_TELEMETRY_LEVEL HW_TELEMETRY_LEVEL_OFF     ///< Records above this level are not compiled, telemetry needs AVR USART0
+#else
+#define HW_TELEMETRY_LEVEL HW_TELEMETRY_LEVEL_DEBUG   ///< Records above this level are not compiled
+#endif
+
+#define HW_TELEMETRY_INTVECT    USART_UDRE_vect   ///< Telemetry transmit interrupt vector (UART data register empty)
+#define HW_TELEMETRY_RX_INTVECT USART_RX_vect     ///< Telemetry request receive interrupt vector
+#define HW_TELEMETRY_BAUD       115200            ///< Telemetry serial port baud rate
+
+/// @}
+///
+/// @addtogroup profiler
+/// @{
+
+//#define HW_PROFILER   ///< Uncomment to compile profiling probes, requires telemetry
+
+/// @}
+///
+/// @addtogroup storage
+/// @{
+
+#define HW_STORAGE_ADDRESS    0       ///< EEPROM address of the first storage slot
+#define HW_STORAGE_SLOTS      32      ///< Number of storage slots, each write goes to the next slot
+#define HW_STORAGE_IDLE_TIME  3000    ///< Lamp state is written when it has not changed for this time (milliseconds)
+
+/// @}
+///
+/// @addtogroup network
+/// @{
+
+#ifdef HW_PROFILE_ESP8266
+#define HW_NETWORK    ///< If defined, neopixel frames are received over UDP, see Network
+#endif
+
+#define HW_NETWORK_SSID           "neopixel_lamp"   ///< WiFi network to connect to
+#define HW_NETWORK_PASSWORD       ""                ///< WiFi network password
+#define HW_NETWORK_PORT           21324             ///< UDP port to receive frames on
+#define HW_NETWORK_OVERRIDE_TIME  10000             ///< Received frames are ignored for this time after the rotary encoder was used (milliseconds)
 
 /// @}
 
@@ -0,0 +1,134 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Host benchmark: time of one full frame render per effect and of colour conversion
+///
+/// Colour conversion cases convert one colour per neopixel, so their time per frame is
+/// the cost of converting the whole frame
+
+#include <chrono>
+#include <cstdio>
+
+#include "colour.h"
+#include "hsv.h"
+#include "effects.h"
+#include "transition.h"
+
+/// @brief Output which stores the rendered frame, stands in for Neopixel
+class HostOutput {
+  public:
+    void setPixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+      red[index] = r;
+      green[index] = g;
+      blue[index] = b;
+    }
+    uint32_t checksum(void) {
+      uint32_t sum = 0;
+      for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++)
+        sum = sum * 31 + red[i] + green[i] * 3 + blue[i] * 7;
+      return (sum);
+    }
+  private:
+    uint8_t red[HW_NEOPIXEL_NUMBER], green[HW_NEOPIXEL_NUMBER], blue[HW_NEOPIXEL_NUMBER];
+};
+
+static const uint32_t frames = 200000;   ///< Frames rendered per case
+
+/// @brief Steps and renders the effect for a number of frames and prints time per frame
+/// @tparam Effect Effect class from effects.h
+/// @param name Name printed in the report
+/// @param effect Effect to benchmark
+template <class Effect>
+static void benchmark(const char * name, Effect & effect) {
+  HostOutput output;
+  uint32_t checksum = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < frames; i++) {
+    effect.step();
+    effect.render(output);
+    checksum += output.checksum();
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  printf("%-14s %8.1f ns/frame (checksum %08x)\n", name, elapsed.count() / frames, (unsigned int)checksum);
+}
+
+/// @brief Renders the transition at every step, same as the lamp does during a fade
+class TransitionBench {
+  public:
+    void step(void) {
+      if (!transition.step()) {
+        static const uint8_t targets[2][3] = {{255, 128, 0}, {0, 64, 255}};
+        transition.start(targets[flip ^= 1], 30);
+      }
+    }
+    void render(HostOutput & output) {
+      for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++)
+        output.setPixel(i, transition.value(0), transition.value(1), transition.value(2));
+    }
+  private:
+    Transition<3> transition;
+    uint8_t flip = 0;
+};
+
+/// @brief Converts hue to RGB for every neopixel with colourFromHue(), same as calcRGB() of the sketch
+class HueBench {
+  public:
+    void step(void) {
+      if (++hue > COLOUR_MAX_HUE) hue = 0;
+    }
+    void render(HostOutput & output) {
+      uint8_t r, g, b;
+      for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++) {
+        colourFromHue((hue + i) % (COLOUR_MAX_HUE + 1), r, g, b);
+        output.setPixel(i, r, g, b);
+      }
+    }
+  private:
+    uint8_t hue = 0;
+};
+
+/// @brief Converts HSV colour to RGB for every neopixel with hsvToRgb(), sweeping hue and saturation
+class HsvBench {
+  public:
+    void step(void) {
+      colour.hue++;
+      colour.saturation += 3;
+    }
+    void render(HostOutput & output) {
+      uint8_t r, g, b;
+      HsvColour pixel = colour;
+      for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++) {
+        hsvToRgb(pixel, r, g, b);
+        output.setPixel(i, r, g, b);
+        pixel.hue += 8;
+      }
+    }
+  private:
+    HsvColour colour = {0, 0, 255};
+};
+
+int main(void) {
+  printf("%d x %d matrix, %lu frames per case\n", HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS, (unsigned long)frames);
+  RainbowEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> rainbowEffect;
+  BreathingEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> breathingEffect;
+  FireEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> fireEffect;
+  TwinkleEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> twinkleEffect;
+  TransitionBench transition;
+  HueBench hue;
+  HsvBench hsv;
+  breathingEffect.setColour(255, 160, 64);
+  twinkleEffect.setColour(255, 255, 255);
+  benchmark("rainbow", rainbowEffect);
+  benchmark("breathing", breathingEffect);
+  benchmark("fire", fireEffect);
+  benchmark("twinkle", twinkleEffect);
+  benchmark("transition", transition);
+  benchmark("colourFromHue", hue);
+  benchmark("hsvToRgb", hsv);
+  return (0);
+}
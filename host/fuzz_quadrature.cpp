@@ -0,0 +1,196 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Host fuzzer: replays A/B traces through quadratureStep()
+///
+/// Recorded traces are read from the file given on the command line (see traces.txt),
+/// then random traces are generated from a model of the shaft position with contact
+/// bounce and noise spikes; in both cases final count and direction of the last step
+/// reported by quadratureStep() are compared with the expected ones
+///
+/// Random traces are also fed through RotEncSampler and RotEnc in bursts of back-to-back
+/// line changes without a tick in between, as while the frame is sent with the tick
+/// masked (see HW_NEOPIXEL_INTERRUPT_WINDOW); the counter must not lose any step
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "quadrature.h"
+#include "rotenc.h"
+
+/// @brief Line levels for each quarter of the quadrature cycle, in the direction of +1
+static const uint8_t grayCode[4] = {0, 2, 3, 1};
+
+/// @brief Decodes the trace
+/// @param samples Line samples, the first one is the starting level
+/// @param count Receives sum of the increments
+/// @param direction Receives the last non-zero increment, 0 if there was none
+static void decode(const std::vector<uint8_t> & samples, int32_t & count, int8_t & direction) {
+  uint8_t state = samples[0];
+  count = 0;
+  direction = 0;
+  for (size_t i = 1; i < samples.size(); i++) {
+    int8_t increment = quadratureStep(state, samples[i]);
+    count += increment;
+    if (increment) direction = increment;
+  }
+}
+
+/// @brief Checks the decoded trace against the expected values and reports a mismatch
+/// @return True if the trace was decoded as expected
+static bool check(const char * name, const std::vector<uint8_t> & samples, int32_t expectedCount, int8_t expectedDirection) {
+  int32_t count;
+  int8_t direction;
+  decode(samples, count, direction);
+  if ((count == expectedCount) && (direction == expectedDirection)) return (true);
+  printf("%s: count %ld direction %d, expected %ld %d; samples", name, (long)count, direction, (long)expectedCount, expectedDirection);
+  for (size_t i = 0; i < samples.size(); i++) printf(" %u", samples[i]);
+  printf("\n");
+  return (false);
+}
+
+/// @brief Replays the traces from the file
+/// @return Number of traces which were not decoded as expected, -1 if the file is invalid
+static long replayFile(const char * fileName, long & total) {
+  FILE * file = fopen(fileName, "r");
+  if (!file) {
+    perror(fileName);
+    return (-1);
+  }
+  long failed = 0;
+  char line[512];
+  unsigned int lineNumber = 0;
+  while (fgets(line, sizeof(line), file)) {
+    lineNumber++;
+    char * token = strtok(line, " \t\r\n");
+    if (!token || (token[0] == '#')) continue;
+    int32_t expectedCount = strtol(token, NULL, 10);
+    token = strtok(NULL, " \t\r\n");
+    int8_t expectedDirection = 0;
+    if (token && !strcmp(token, "+")) expectedDirection = 1;
+    if (token && !strcmp(token, "-")) expectedDirection = -1;
+    std::vector<uint8_t> samples;
+    while ((token = strtok(NULL, " \t\r\n"))) samples.push_back(strtoul(token, NULL, 10) & 3);
+    if (samples.empty()) {
+      printf("%s:%u: no samples\n", fileName, lineNumber);
+      fclose(file);
+      return (-1);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s:%u", fileName, lineNumber);
+    if (!check(name, samples, expectedCount, expectedDirection)) failed++;
+    total++;
+  }
+  fclose(file);
+  return (failed);
+}
+
+/// @brief Generates a random trace from the shaft position model
+///
+/// Every move changes one line (one quarter of the quadrature cycle); a move may bounce,
+/// i.e. the line toggles back and forth before settling; a noise spike flips both lines
+/// for one sample and is expected to be ignored
+///
+/// @param samples Receives the trace
+/// @param count Receives the expected count
+/// @param direction Receives the expected direction of the last step
+static void generate(std::vector<uint8_t> & samples, int32_t & count, int8_t & direction) {
+  uint8_t phase = rand() & 3;
+  samples.clear();
+  samples.push_back(grayCode[phase]);
+  count = 0;
+  direction = 0;
+  unsigned int moves = rand() % 200;
+  for (unsigned int i = 0; i < moves; i++) {
+    if (!(rand() % 16)) {
+      samples.push_back(grayCode[phase] ^ 3);
+      samples.push_back(grayCode[phase]);
+      continue;
+    }
+    int8_t step = (rand() & 1) ? 1 : -1;
+    uint8_t next = (phase + step) & 3;
+    unsigned int bounces = (rand() % 4) ? 0 : (rand() % 4);
+    for (unsigned int j = 0; j < bounces; j++) {
+      samples.push_back(grayCode[next]);
+      samples.push_back(grayCode[phase]);
+    }
+    samples.push_back(grayCode[next]);
+    phase = next;
+    count += step;
+    direction = step;
+  }
+}
+
+/// @brief Port traits of the simulated encoder pins, levels are driven by the trace
+struct HostPort {
+  static uint8_t level;       ///< Pin levels, lines A and B are bits 0 and 1, button is bit 2
+  static inline uint8_t read(void) { return (level); }
+  static inline void setInputPullup(uint8_t) {}
+  static inline void enablePinChange(uint8_t) {}
+  static inline void disablePinChange(uint8_t) {}
+  static inline void enablePinChangeInterrupt(void) {}
+};
+
+uint8_t HostPort::level = 0;
+
+/// @brief Feeds the trace through the sampler in bursts and checks the counter
+///
+/// Every sample is a line change followed by the Pin Change ISR; after a burst of up to
+/// maxBurst samples the tick decodes the queued snapshots
+///
+/// @return True if the counter equals the expected count
+static bool checkFrames(const char * name, const std::vector<uint8_t> & samples, int32_t expectedCount) {
+  static const uint8_t maxBurst = 15;
+  RotEncSampler<HostPort> sampler;
+  RotEnc<HostPort, 0, 1, 2, 1> rotenc;
+  HostPort::level = samples[0] | _BV(2);
+  rotenc.begin();
+  rotenc.setCounter(0, -1000, 1000, false, false);
+  size_t i = 1;
+  while (i < samples.size()) {
+    unsigned int burst = 1 + rand() % maxBurst;
+    for (; burst && (i < samples.size()); burst--, i++) {
+      HostPort::level = samples[i] | _BV(2);
+      sampler.interruptHandler();
+    }
+    uint8_t port;
+    while (sampler.getSample(port)) rotenc.lineHandler(port);
+    rotenc.tickInterruptHandler();
+  }
+  int16_t counter = rotenc.getCounter();
+  if (counter == expectedCount) return (true);
+  printf("%s: counter %d after bursts, expected %ld\n", name, counter, (long)expectedCount);
+  return (false);
+}
+
+int main(int argc, char * argv[]) {
+  long total = 0;
+  long failed = 0;
+  for (int i = 1; i < argc; i++) {
+    long fileFailed = replayFile(argv[i], total);
+    if (fileFailed < 0) return (2);
+    failed += fileFailed;
+  }
+  static const long randomTraces = 100000;
+  srand(1);
+  std::vector<uint8_t> samples;
+  for (long i = 0; i < randomTraces; i++) {
+    int32_t count;
+    int8_t direction;
+    generate(samples, count, direction);
+    char name[32];
+    snprintf(name, sizeof(name), "random #%ld", i);
+    if (!check(name, samples, count, direction)) failed++;
+    if (!checkFrames(name, samples, count)) failed++;
+    total++;
+  }
+  printf("%ld traces, %ld failed\n", total, failed);
+  return (failed ? 1 : 0);
+}
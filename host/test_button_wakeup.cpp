@@ -0,0 +1,115 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Host test: button press which wakes the MCU from power-down raises a click event
+///
+/// Models sleepUntilInterrupt() of the sketch: in power-down the scheduler tick stops and
+/// only a pin change wakes the MCU up; after wakeup idle sleep (tick running) is used
+/// while RotEnc::isButtonActive() is true
+
+#include <cstdio>
+
+#include "rotenc.h"
+
+/// @brief Port traits of the simulated encoder pins, lines and button are pulled up
+struct HostPort {
+  static uint8_t level;       ///< Pin levels
+  static uint8_t pinChange;   ///< Pins with pin change interrupt enabled
+  static inline uint8_t read(void) { return (level); }
+  static inline void setInputPullup(uint8_t bit) { level |= _BV(bit); }
+  static inline void enablePinChange(uint8_t bit) { pinChange |= _BV(bit); }
+  static inline void disablePinChange(uint8_t bit) { pinChange &= ~_BV(bit); }
+  static inline void enablePinChangeInterrupt(void) {}
+};
+
+uint8_t HostPort::level = 0;
+uint8_t HostPort::pinChange = 0;
+
+static const uint8_t bitA = 0;
+static const uint8_t bitB = 1;
+static const uint8_t bitBtn = 2;
+
+typedef RotEnc<HostPort, bitA, bitB, bitBtn, 4> HostRotEnc;
+
+static const uint32_t msPerTick = 1000 / HW_SCHEDULER_TICK_RATE;
+
+/// @brief Lamp which is off: MCU sleeps in power-down unless the button is active
+class SleepingLamp {
+  public:
+    SleepingLamp() : poweredDown(false) {
+      rotenc.begin();
+      rotenc.setCounter(0, -100, 100, false, false);
+    }
+    /// @brief Sets button level, wakes the MCU up if its pin change interrupt is enabled
+    void setButton(bool pressed) {
+      uint8_t old = HostPort::level;
+      if (pressed)
+        HostPort::level &= ~_BV(bitBtn);
+      else
+        HostPort::level |= _BV(bitBtn);
+      if (poweredDown && ((old ^ HostPort::level) & HostPort::pinChange)) {
+        poweredDown = false;
+        rotenc.setButtonWakeup(false);
+      }
+    }
+    /// @brief Runs the main loop for the time, returns true if the event was retrieved
+    bool run(uint32_t ms, RotEncBase::EventType type) {
+      bool found = false;
+      for (uint32_t i = 0; i < ms; i += msPerTick) {
+        RotEncBase::Event event;
+        while (rotenc.getEvent(event)) {
+          if (event.type == type) found = true;
+        }
+        if (!poweredDown && !rotenc.isButtonActive()) {
+          rotenc.setButtonWakeup(true);
+          poweredDown = true;
+        }
+        if (!poweredDown) rotenc.tickInterruptHandler();
+      }
+      return (found);
+    }
+    bool isPoweredDown(void) { return (poweredDown); }
+  private:
+    HostRotEnc rotenc;
+    bool poweredDown;
+};
+
+/// @brief Presses the button while powered down and checks that the event is raised
+/// @param name Name printed in the report
+/// @param pressMs Time the button is held
+/// @param bounceMs Time the contacts bounce on press, toggling every millisecond
+/// @param type Expected event
+/// @return True if the event was raised and the MCU powered down again afterwards
+static bool check(const char * name, uint32_t pressMs, uint32_t bounceMs, RotEncBase::EventType type) {
+  SleepingLamp lamp;
+  bool found = lamp.run(10, type);
+  if (!lamp.isPoweredDown()) {
+    printf("%s: lamp which is off did not power down\n", name);
+    return (false);
+  }
+  for (uint32_t i = 0; i < bounceMs; i++) {
+    lamp.setButton(!(i & 1));
+    found |= lamp.run(1, type);
+  }
+  lamp.setButton(true);
+  found |= lamp.run(pressMs, type);
+  lamp.setButton(false);
+  found |= lamp.run(2000, type);
+  if (!found) printf("%s: event %d was not raised\n", name, type);
+  if (!lamp.isPoweredDown()) printf("%s: lamp did not power down after the click\n", name);
+  return (found && lamp.isPoweredDown());
+}
+
+int main(void) {
+  unsigned int failed = 0;
+  if (!check("short click", 100, 0, RotEncBase::EVENT_SHORT_CLICK)) failed++;
+  if (!check("short click with bounce", 100, 4, RotEncBase::EVENT_SHORT_CLICK)) failed++;
+  if (!check("long click", 800, 4, RotEncBase::EVENT_LONG_CLICK)) failed++;
+  printf("button wakeup: %u failed\n", failed);
+  return (failed ? 1 : 0);
+}
@@ -0,0 +1,85 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Fixed-point HSV colour model
+
+#ifndef HSV_H
+#define HSV_H
+
+#include "hal.h"
+
+/// @defgroup hsv HSV colour model
+/// @brief Conversion of HSV colours to RGB components suitable for neopixels
+///
+/// All calculations are fixed-point and use only 8x8 multiplications, no divisions
+///
+/// @{
+
+/// @brief Colour in HSV colour model
+struct HsvColour {
+  uint8_t hue;          ///< Hue, full colour circle is 0..255 (0 is red, 85 is green, 170 is blue)
+  uint8_t saturation;   ///< Saturation, range 0..255 (0 is white, 255 is pure colour)
+  uint8_t value;        ///< Value, range 0..255 (0 is off, 255 is full brightness)
+};
+
+inline uint8_t hsvScale(uint8_t input, uint8_t scale);
+inline void hsvToRgb(const HsvColour & colour, uint8_t & r, uint8_t & g, uint8_t & b);
+
+/// @}
+
+//////////////////////////////////////////////////////////////////////
+// HSV inline functions
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Scales 8-bit value by 8-bit fraction
+/// @param input Value to scale, range 0..255
+/// @param scale Scale factor, range 0..255 (0 results in 0, 255 returns input unchanged)
+/// @return input * scale / 255, calculated without division
+uint8_t hsvScale(uint8_t input, uint8_t scale) {
+  return (((uint16_t)input * (scale + 1)) >> 8);
+}
+
+/// @brief Converts HSV colour to RGB components
+/// @param colour Colour to convert
+/// @param r Red component of the colour, range 0..255
+/// @param g Green component of the colour, range 0..255
+/// @param b Blue component of the colour, range 0..255
+void hsvToRgb(const HsvColour & colour, uint8_t & r, uint8_t & g, uint8_t & b) {
+  static const uint8_t sectors = 6;
+  static const uint8_t colourMax = 255;
+  // Hue is scaled to 6 sectors with 8-bit position within the sector
+  uint16_t scaledHue = (uint16_t)colour.hue * sectors;
+  uint8_t sector = scaledHue >> 8;
+  uint8_t position = scaledHue & 0xff;
+  uint8_t value = colour.value;
+  uint8_t minimum = hsvScale(value, colourMax - colour.saturation);
+  uint8_t falling = hsvScale(value, colourMax - hsvScale(colour.saturation, position));
+  uint8_t rising = hsvScale(value, colourMax - hsvScale(colour.saturation, colourMax - position));
+  switch (sector) {
+    case 0:
+      r = value; g = rising; b = minimum;
+      break;
+    case 1:
+      r = falling; g = value; b = minimum;
+      break;
+    case 2:
+      r = minimum; g = value; b = rising;
+      break;
+    case 3:
+      r = minimum; g = falling; b = value;
+      break;
+    case 4:
+      r = rising; g = minimum; b = value;
+      break;
+    default:
+      r = value; g = minimum; b = falling;
+      break;
+  }
+}
+
+#endif // #ifndef HSV_H
@@ -0,0 +1,79 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "matrix.h"
+#include "hardware.h"
+
+#define MATRIX_TABLE_1(entry, p) entry(p),                                                    ///< 1 table entry
+#define MATRIX_TABLE_2(entry, p) MATRIX_TABLE_1(entry, p) MATRIX_TABLE_1(entry, (p) + 1)      ///< 2 table entries
+#define MATRIX_TABLE_4(entry, p) MATRIX_TABLE_2(entry, p) MATRIX_TABLE_2(entry, (p) + 2)      ///< 4 table entries
+#define MATRIX_TABLE_8(entry, p) MATRIX_TABLE_4(entry, p) MATRIX_TABLE_4(entry, (p) + 4)      ///< 8 table entries
+#define MATRIX_TABLE_16(entry, p) MATRIX_TABLE_8(entry, p) MATRIX_TABLE_8(entry, (p) + 8)     ///< 16 table entries
+#define MATRIX_TABLE_32(entry, p) MATRIX_TABLE_16(entry, p) MATRIX_TABLE_16(entry, (p) + 16)  ///< 32 table entries
+#define MATRIX_TABLE_64(entry, p) MATRIX_TABLE_32(entry, p) MATRIX_TABLE_32(entry, (p) + 32)  ///< 64 table entries
+#define MATRIX_TABLE_128(entry, p) MATRIX_TABLE_64(entry, p) MATRIX_TABLE_64(entry, (p) + 64) ///< 128 table entries
+
+/// @brief Neopixel index for every position in the matrix
+///
+/// The tables are assembled from blocks of power-of-two sizes according to the binary
+/// representation of HW_NEOPIXEL_NUMBER
+const uint8_t matrixLayout[HW_NEOPIXEL_NUMBER] PROGMEM = {
+#if HW_NEOPIXEL_NUMBER & 128
+  MATRIX_TABLE_128(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~255)
+#endif
+#if HW_NEOPIXEL_NUMBER & 64
+  MATRIX_TABLE_64(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~127)
+#endif
+#if HW_NEOPIXEL_NUMBER & 32
+  MATRIX_TABLE_32(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~63)
+#endif
+#if HW_NEOPIXEL_NUMBER & 16
+  MATRIX_TABLE_16(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~31)
+#endif
+#if HW_NEOPIXEL_NUMBER & 8
+  MATRIX_TABLE_8(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~15)
+#endif
+#if HW_NEOPIXEL_NUMBER & 4
+  MATRIX_TABLE_4(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~7)
+#endif
+#if HW_NEOPIXEL_NUMBER & 2
+  MATRIX_TABLE_2(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~3)
+#endif
+#if HW_NEOPIXEL_NUMBER & 1
+  MATRIX_TABLE_1(MATRIX_LAYOUT_ENTRY, HW_NEOPIXEL_NUMBER & ~1)
+#endif
+};
+
+/// @brief Matrix column for every neopixel index
+///
+/// Indexed by neopixel index, see matrixLayout for the table assembly
+const uint8_t matrixColumns[HW_NEOPIXEL_NUMBER] PROGMEM = {
+#if HW_NEOPIXEL_NUMBER & 128
+  MATRIX_TABLE_128(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~255)
+#endif
+#if HW_NEOPIXEL_NUMBER & 64
+  MATRIX_TABLE_64(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~127)
+#endif
+#if HW_NEOPIXEL_NUMBER & 32
+  MATRIX_TABLE_32(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~63)
+#endif
+#if HW_NEOPIXEL_NUMBER & 16
+  MATRIX_TABLE_16(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~31)
+#endif
+#if HW_NEOPIXEL_NUMBER & 8
+  MATRIX_TABLE_8(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~15)
+#endif
+#if HW_NEOPIXEL_NUMBER & 4
+  MATRIX_TABLE_4(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~7)
+#endif
+#if HW_NEOPIXEL_NUMBER & 2
+  MATRIX_TABLE_2(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~3)
+#endif
+#if HW_NEOPIXEL_NUMBER & 1
+  MATRIX_TABLE_1(MATRIX_COLUMN_ENTRY, HW_NEOPIXEL_NUMBER & ~1)
+#endif
+};
@@ -0,0 +1,95 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Mapping of neopixel matrix coordinates to neopixel indexes
+
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include "hal.h"
+
+#include "hardware.h"
+
+/// @defgroup matrix Neopixel matrix layout
+/// @brief Maps matrix coordinates to indexes of neopixels in the chain
+///
+/// Neopixel matrix has HW_NEOPIXEL_COLS columns (x coordinate) and HW_NEOPIXEL_ROWS rows
+/// (y coordinate); position of the neopixel in the matrix is y * HW_NEOPIXEL_COLS + x.
+///
+/// Indexes of neopixels for every position are calculated at compile time according to
+/// HW_NEOPIXEL_LAYOUT and stored in the flash memory, so the mapping is a single table
+/// lookup: iterating positions sequentially requires no multiplications or branches
+///
+/// @{
+
+inline uint8_t matrixIndex(uint8_t position);
+inline uint8_t matrixIndex(uint8_t x, uint8_t y);
+inline uint8_t matrixColumn(uint8_t index);
+
+/// @}
+
+#if HW_NEOPIXEL_NUMBER > 255
+#error "Neopixel matrix layout supports up to 255 neopixels"
+#endif
+
+/// @def MATRIX_LAYOUT_ENTRY(p)
+/// @brief Neopixel index for the matrix position, generated at compile time
+/// @param p Position in the matrix, y * HW_NEOPIXEL_COLS + x
+///
+/// @def MATRIX_COLUMN_ENTRY(i)
+/// @brief Matrix column for the neopixel index, generated at compile time
+/// @param i Index of the neopixel in the chain
+#if HW_NEOPIXEL_LAYOUT == HW_NEOPIXEL_LAYOUT_COLUMNS
+#define MATRIX_LAYOUT_ENTRY(p) (((p) % HW_NEOPIXEL_COLS) * HW_NEOPIXEL_ROWS + (p) / HW_NEOPIXEL_COLS)
+#define MATRIX_COLUMN_ENTRY(i) ((i) / HW_NEOPIXEL_ROWS)
+#elif HW_NEOPIXEL_LAYOUT == HW_NEOPIXEL_LAYOUT_ROWS
+#define MATRIX_LAYOUT_ENTRY(p) (p)
+#define MATRIX_COLUMN_ENTRY(i) ((i) % HW_NEOPIXEL_COLS)
+#elif HW_NEOPIXEL_LAYOUT == HW_NEOPIXEL_LAYOUT_COLUMNS_SERPENTINE
+#define MATRIX_LAYOUT_ENTRY(p) (((p) % HW_NEOPIXEL_COLS) * HW_NEOPIXEL_ROWS + \
+  ((((p) % HW_NEOPIXEL_COLS) & 1) ? (HW_NEOPIXEL_ROWS - 1 - (p) / HW_NEOPIXEL_COLS) : ((p) / HW_NEOPIXEL_COLS)))
+#define MATRIX_COLUMN_ENTRY(i) ((i) / HW_NEOPIXEL_ROWS)
+#elif HW_NEOPIXEL_LAYOUT == HW_NEOPIXEL_LAYOUT_ROWS_SERPENTINE
+#define MATRIX_LAYOUT_ENTRY(p) (((p) / HW_NEOPIXEL_COLS) * HW_NEOPIXEL_COLS + \
+  ((((p) / HW_NEOPIXEL_COLS) & 1) ? (HW_NEOPIXEL_COLS - 1 - (p) % HW_NEOPIXEL_COLS) : ((p) % HW_NEOPIXEL_COLS)))
+#define MATRIX_COLUMN_ENTRY(i) \
+  ((((i) / HW_NEOPIXEL_COLS) & 1) ? (HW_NEOPIXEL_COLS - 1 - (i) % HW_NEOPIXEL_COLS) : ((i) % HW_NEOPIXEL_COLS))
+#else
+#error "Unknown HW_NEOPIXEL_LAYOUT"
+#endif
+
+extern const uint8_t matrixLayout[HW_NEOPIXEL_NUMBER] PROGMEM;
+extern const uint8_t matrixColumns[HW_NEOPIXEL_NUMBER] PROGMEM;
+
+//////////////////////////////////////////////////////////////////////
+// Matrix inline functions
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Get neopixel index for the position in the matrix
+/// @param position Position in the matrix, y * HW_NEOPIXEL_COLS + x
+/// @return Index of the neopixel in the chain
+uint8_t matrixIndex(uint8_t position) {
+  return (pgm_read_byte(&matrixLayout[position]));
+}
+
+/// @brief Get neopixel index for matrix coordinates
+/// @param x Column, range 0..HW_NEOPIXEL_COLS-1
+/// @param y Row, range 0..HW_NEOPIXEL_ROWS-1
+/// @return Index of the neopixel in the chain
+uint8_t matrixIndex(uint8_t x, uint8_t y) {
+  return (matrixIndex(y * HW_NEOPIXEL_COLS + x));
+}
+
+/// @brief Get matrix column of the neopixel, inverse of matrixIndex() for the x coordinate
+/// @param index Index of the neopixel in the chain
+/// @return Column, range 0..HW_NEOPIXEL_COLS-1
+uint8_t matrixColumn(uint8_t index) {
+  return (pgm_read_byte(&matrixColumns[index]));
+}
+
+#endif // #ifndef MATRIX_H
@@ -9,24 +9,404 @@
 
 #include "hardware.h"
 #include "neopixel.h"
+#include "profiler.h"
+
+#ifdef HW_NEOPIXEL_GAMMA
+/// @brief Gamma correction table, output = 255 * (input / 255) ^ 2.2, generated by tools/gamma_table.py
+const uint8_t gammaTable[256] PROGMEM = {
+    0,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+    3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+    6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+   12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+   20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+   30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+   42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+   56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+   73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+   91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+  113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+  137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+  163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+  192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+  223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
+
+#ifdef HW_NEOPIXEL_DITHER
+/// @brief Dither scale for each brightness, same curve as gammaTable with 16-bit precision
+const uint16_t gammaDitherScale[256] PROGMEM = {
+      0,   256,   256,   256,   256,   256,   256,   256,   256,   256,   256,   256,   256,   256,   256,   256,
+    256,   256,   256,   256,   256,   269,   298,   329,   361,   395,   431,   468,   507,   548,   590,   634,
+    680,   728,   778,   829,   882,   937,   994,  1052,  1112,  1174,  1238,  1304,  1372,  1442,  1513,  1586,
+   1662,  1739,  1818,  1899,  1982,  2067,  2154,  2242,  2333,  2426,  2520,  2617,  2716,  2816,  2919,  3023,
+   3130,  3239,  3349,  3462,  3577,  3694,  3812,  3933,  4056,  4181,  4308,  4437,  4569,  4702,  4837,  4975,
+   5115,  5256,  5400,  5546,  5694,  5844,  5997,  6151,  6308,  6467,  6628,  6791,  6956,  7123,  7293,  7465,
+   7639,  7815,  7993,  8174,  8357,  8542,  8729,  8918,  9110,  9304,  9500,  9698,  9899, 10102, 10307, 10514,
+  10723, 10935, 11149, 11366, 11584, 11805, 12028, 12253, 12481, 12711, 12943, 13178, 13415, 13654, 13896, 14139,
+  14385, 14634, 14885, 15138, 15393, 15651, 15911, 16173, 16438, 16705, 16975, 17246, 17521, 17797, 18076, 18357,
+  18641, 18927, 19215, 19506, 19799, 20095, 20393, 20693, 20996, 21301, 21608, 21918, 22230, 22545, 22862, 23182,
+  23504, 23828, 24155, 24484, 24816, 25150, 25487, 25826, 26167, 26511, 26857, 27206, 27557, 27911, 28267, 28626,
+  28987, 29351, 29717, 30085, 30456, 30830, 31206, 31584, 31965, 32349, 32735, 33123, 33514, 33907, 34303, 34702,
+  35103, 35506, 35912, 36321, 36732, 37145, 37562, 37980, 38401, 38825, 39251, 39680, 40111, 40545, 40982, 41421,
+  41862, 42306, 42753, 43202, 43654, 44108, 44565, 45024, 45486, 45951, 46418, 46888, 47360, 47835, 48312, 48793,
+  49275, 49760, 50248, 50739, 51232, 51727, 52226, 52727, 53230, 53736, 54245, 54756, 55270, 55787, 56306, 56828,
+  57352, 57879, 58409, 58941, 59476, 60014, 60554, 61097, 61642, 62190, 62741, 63295, 63851, 64410, 64971, 65535
+};
+#endif
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Neopixel
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises private fields with default values
+///
+/// All neopixels are marked as changed so that the first update always reaches the
+/// neopixels, regardless of what they displayed before reset
+Neopixel::Neopixel() {
+#ifndef HW_NEOPIXEL_STREAMING
+  memset(frame, 0, sizeof(frame));
+  changedPixels = HW_NEOPIXEL_NUMBER;
+#endif
+  latchStartTime = 0;
+  outputScale = outputScaleMax;
+#ifdef HW_NEOPIXEL_DITHER
+  memset(ditherError, 0, sizeof(ditherError));
+  ditherScale = 0xffff;
+  ditherActive = false;
+#endif
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+  brightnessScale = outputScaleMax;
+#ifdef HW_NEOPIXEL_DITHER
+  brightnessDitherScale = 0xffff;
+#endif
+  channelLoad = 0;
+  loadPendingFirst = 0;
+  loadPendingNumber = 0;
+#endif
+}
 
 /// @brief Set up a neopixel array for use
 void Neopixel::begin(void) {
-  ///Set neopixel pin to output mode
+#if HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_SPI
+  //Set MOSI, SCK and SS pins to output mode, SS must be output to keep SPI in master mode
+  bitSet(HW_NEOPIXEL_SPI_DIR, HW_NEOPIXEL_SPI_MOSI_BIT);
+  bitSet(HW_NEOPIXEL_SPI_DIR, HW_NEOPIXEL_SPI_SCK_BIT);
+  bitSet(HW_NEOPIXEL_SPI_DIR, HW_NEOPIXEL_SPI_SS_BIT);
+  //Enable SPI master, mode 0, MSB first, 4 MHz SPI clock
+#if F_CPU == 16000000L
+  SPCR = _BV(SPE) | _BV(MSTR);
+  SPSR = 0;
+#elif F_CPU == 8000000L
+  SPCR = _BV(SPE) | _BV(MSTR);
+  SPSR = _BV(SPI2X);
+#else
+#error "SPI neopixel backend requires F_CPU of 8 MHz or 16 MHz"
+#endif
+#elif HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_UART
+  //UART1 transmits only, 6N1, TX inverted so that idle line is low
+  Serial1.begin(HW_NEOPIXEL_UART_BAUD, SERIAL_6N1, SERIAL_TX_ONLY);
+  USC0(UART1) |= _BV(UCTXI);
+#else
+  //Set neopixel pin to output mode
   bitSet(HW_NEOPIXEL_DIR, HW_NEOPIXEL_BIT);
+#endif
 }
 
+#ifndef HW_NEOPIXEL_STREAMING
+
 /// @brief Set all available neopixels to the same colour
+///
+/// The neopixels are not updated until update() is called
+///
 /// @param r Red component, range 0..255
 /// @param g Green component, range 0..255
 /// @param b Blue component, range 0..255
 void Neopixel::setUniformColour(uint8_t r, uint8_t g, uint8_t b) {
-  noInterrupts();
-  for (int i = 0; i < HW_NEOPIXEL_NUMBER; i++) {
-    sendRgb(r, g, b);
+  PROFILE_SCOPE(PROFILE_SET_UNIFORM);
+  for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++) {
+    setPixel(i, r, g, b);
   }
+}
+
+/// @brief Set each neopixel to its own colour
+///
+/// The neopixels are not updated until update() is called
+///
+/// @param r Red components of neopixels, range 0..255, HW_NEOPIXEL_NUMBER values
+/// @param g Green components of neopixels, range 0..255, HW_NEOPIXEL_NUMBER values
+/// @param b Blue components of neopixels, range 0..255, HW_NEOPIXEL_NUMBER values
+void Neopixel::setFromArray(uint8_t r[], uint8_t g[], uint8_t b[]) {
+  for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++) {
+    setPixel(i, r[i], g[i], b[i]);
+  }
+}
+
+/// @brief Set each neopixel to its own HSV colour
+///
+/// HSV colours are converted directly into the frame buffer; the neopixels are not updated
+/// until update() is called
+///
+/// @param pixels Colours of neopixels, HW_NEOPIXEL_NUMBER values
+void Neopixel::setFromHsv(const HsvColour pixels[]) {
+  for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++) {
+    setPixel(i, pixels[i]);
+  }
+}
+
+/// @brief Set a range of neopixels to the same colour
+///
+/// The neopixels are not updated until update() is called
+///
+/// @param first Index of the first neopixel in range
+/// @param number Number of neopixels in range
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+void Neopixel::setRange(uint8_t first, uint8_t number, uint8_t r, uint8_t g, uint8_t b) {
+  for (uint8_t i = 0; i < number; i++) {
+    setPixel(first + i, r, g, b);
+  }
+}
+
+/// @brief Gives direct access to a range of neopixels in the frame buffer
+///
+/// Colours are written in wire order (green, red, blue per neopixel) without conversion,
+/// e.g. received from the network straight into the frame buffer; the range is marked as
+/// changed and the neopixels are not updated until update() is called
+///
+/// @param first Index of the first neopixel in range
+/// @param number Number of neopixels in range
+/// @return Pointer to number * 3 bytes of the frame buffer or NULL if the range does not fit
+/// into HW_NEOPIXEL_NUMBER neopixels
+uint8_t * Neopixel::writePixels(uint8_t first, uint8_t number) {
+  if (((uint16_t)first + number) > HW_NEOPIXEL_NUMBER) return (NULL);
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+  //New colours are added to the sum of colour components once they are written
+  settleLoad();
+  channelLoad -= rangeLoad(first, number);
+  loadPendingFirst = first;
+  loadPendingNumber = number;
+#endif
+  if (changedPixels < (first + number)) changedPixels = first + number;
+  return (&frame[first * bytesPerPixel]);
+}
+
+#endif
+
+/// @brief Sets global brightness of the neopixels
+///
+/// Brightness is applied while the frame is being sent; if HW_NEOPIXEL_GAMMA is defined,
+/// the brightness is gamma-corrected as well as the colour components, with temporal
+/// dithering the same curve is taken with 16-bit precision (gammaDitherScale)
+///
+/// If HW_NEOPIXEL_POWER_LIMIT is defined, the brightness may be further reduced by update()
+///
+/// @param brightness Brightness, range 0..255 (255 is full brightness)
+void Neopixel::setBrightness(uint8_t brightness) {
+#ifdef HW_NEOPIXEL_GAMMA
+  uint16_t scale = pgm_read_byte(&gammaTable[brightness]) + 1;
+#else
+  uint16_t scale = brightness + 1;
+#endif
+#ifdef HW_NEOPIXEL_DITHER
+#ifdef HW_NEOPIXEL_GAMMA
+  uint16_t newDitherScale = pgm_read_word(&gammaDitherScale[brightness]);
+#else
+  uint16_t newDitherScale = ((uint16_t)brightness << 8) | 0xff;
+#endif
+#endif
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+  //Output scale is derived from the brightness by update(), which also detects the change
+  HalAtomicState oldSREG = halAtomicBegin();
+  brightnessScale = scale;
+#ifdef HW_NEOPIXEL_DITHER
+  brightnessDitherScale = newDitherScale;
+#endif
+#else
+#ifdef HW_NEOPIXEL_DITHER
+  if ((scale == outputScale) && (newDitherScale == ditherScale)) return;
+  HalAtomicState oldSREG = halAtomicBegin();
+  ditherScale = newDitherScale;
+#else
+  if (scale == outputScale) return;
+  HalAtomicState oldSREG = halAtomicBegin();
+#endif
+  outputScale = scale;
+#ifndef HW_NEOPIXEL_STREAMING
+  changedPixels = HW_NEOPIXEL_NUMBER;
+#endif
+#endif
+  halAtomicEnd(oldSREG);
+}
+
+#ifdef HW_NEOPIXEL_DITHER
+/// @brief Applies gamma correction (if enabled), global brightness and temporal dithering to
+/// the frame buffer and stores the result into the output buffer
+///
+/// Each colour component is scaled to 8.16 fixed point; the integer part is sent to the
+/// neopixels and upper 8 bits of the fractional part are accumulated over the frames; when
+/// accumulator overflows, the component sent to neopixels is incremented, so that average
+/// value over the frames includes the fractional part
+///
+/// @param pixels Number of leading neopixels to process
+void Neopixel::ditherFrame(uint8_t pixels) {
+  static const uint8_t fractionShift = 8;
+  static const uint8_t integerShift = 16;
+  bool active = false;
+  uint16_t size = pixels * bytesPerPixel;
+  for (uint16_t i = 0; i < size; i++) {
+    uint8_t input = frame[i];
+#ifdef HW_NEOPIXEL_GAMMA
+    input = pgm_read_byte(&gammaTable[input]);
+#endif
+    uint32_t value = (uint32_t)input * ditherScale + input;
+    uint8_t result = value >> integerShift;
+    uint8_t fraction = value >> fractionShift;
+    if (fraction) active = true;
+    uint8_t error = ditherError[i] + fraction;
+    if (error < fraction) result++;
+    ditherError[i] = error;
+    output[i] = result;
+  }
+  ditherActive = active;
+}
+#endif
+
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+
+/// @brief Calculates sum of colour components of a range of neopixels in the frame buffer
+/// @param first Index of the first neopixel in range
+/// @param number Number of neopixels in range
+/// @return Sum of colour components as returned by componentLoad()
+uint32_t Neopixel::rangeLoad(uint8_t first, uint8_t number) {
+  const uint8_t * data = &frame[first * bytesPerPixel];
+  uint16_t size = number * bytesPerPixel;
+  uint32_t load = 0;
+  for (uint16_t i = 0; i < size; i++)
+    load += componentLoad(data[i]);
+  return (load);
+}
+
+/// @brief Adds neopixels written through writePixels() to the sum of colour components
+void Neopixel::settleLoad(void) {
+  if (!loadPendingNumber) return;
+  channelLoad += rangeLoad(loadPendingFirst, loadPendingNumber);
+  loadPendingNumber = 0;
+}
+
+/// @brief Calculates output scale from brightness, reduced so that estimated neopixel
+/// current stays within HW_NEOPIXEL_POWER_BUDGET
+///
+/// Current drawn by the colour components is channelLoad * HW_NEOPIXEL_CHANNEL_CURRENT / 255
+/// at full brightness and is proportional to the output scale; idle current of the
+/// neopixels does not depend on the colours. The estimate is calculated once per frame
+///
+/// @return True if output scale was changed and the whole frame must be sent
+bool Neopixel::limitPower(void) {
+  static const uint32_t availableCurrent = HW_NEOPIXEL_POWER_BUDGET - (uint32_t)HW_NEOPIXEL_IDLE_CURRENT * HW_NEOPIXEL_NUMBER;
+  uint16_t scale = brightnessScale;
+  uint32_t fullLoad = channelLoad * HW_NEOPIXEL_CHANNEL_CURRENT;
+  if (fullLoad) {
+    uint32_t limit = availableCurrent * 255 * outputScaleMax / fullLoad;
+    if (limit < scale) scale = limit ? limit : 1;
+  }
+#ifdef HW_NEOPIXEL_DITHER
+  uint16_t newDitherScale = brightnessDitherScale;
+  if (scale != brightnessScale)
+    newDitherScale = (uint32_t)(brightnessDitherScale + 1UL) * scale / brightnessScale - 1;
+  bool changed = (scale != outputScale) || (newDitherScale != ditherScale);
+  ditherScale = newDitherScale;
+#else
+  bool changed = (scale != outputScale);
+#endif
+  outputScale = scale;
+  return (changed);
+}
+
+#endif
+
+#ifndef HW_NEOPIXEL_STREAMING
+
+/// @brief Sends the frame buffer to the neopixel array and latches it
+///
+/// Does nothing if the frame buffer was not changed since the previous update, otherwise
+/// sends neopixels up to the last changed one
+///
+/// If HW_NEOPIXEL_DITHER is defined, the whole frame is sent on each update as long as there
+/// are colour components with fractional parts, thus this method must be called periodically
+///
+/// If HW_NEOPIXEL_POWER_LIMIT is defined, output scale is recalculated from the brightness
+/// and current estimate, and the whole frame is sent when it changes
+///
+/// @warning This method must not be re-entered, e.g. it must not be called from the main
+/// loop if it is also called from the frame scheduler's interrupt
+void Neopixel::update(void) {
+  uint8_t pixels = changedPixels;
+  changedPixels = 0;
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+  settleLoad();
+  if (limitPower()) pixels = HW_NEOPIXEL_NUMBER;
+#endif
+#ifdef HW_NEOPIXEL_DITHER
+  if (ditherActive) pixels = HW_NEOPIXEL_NUMBER;
+  if (!pixels) return;
+  ditherFrame(pixels);
+  transmit(output, pixels, false);
+#else
+  if (!pixels) return;
+  transmit(frame, pixels, isOutputTransformed());
+#endif
   show();
-  noInterrupts();
+}
 
+/// @brief Sends the buffer to the neopixel array
+///
+/// With bit-bang backend interrupts are disabled while the neopixel data are sent; if
+/// HW_NEOPIXEL_INTERRUPT_WINDOW is defined, interrupts are disabled for a single neopixel
+/// at a time and pending interrupts which are not masked by TransmitInterruptMask are
+/// serviced between neopixels
+///
+/// If colour components need to be transformed (see setBrightness()), each neopixel is
+/// transformed just before it is sent, so no separate pass over the frame buffer is made
+///
+/// @param buffer Buffer to send, frameSize bytes
+/// @param pixels Number of leading neopixels to send
+/// @param transformed If true, gamma correction and brightness are applied to the buffer
+void Neopixel::transmit(const uint8_t * buffer, uint8_t pixels, bool transformed) {
+  waitLatch();
+  PROFILE_SCOPE(PROFILE_TRANSMIT);
+#ifdef HW_NEOPIXEL_INTERRUPT_WINDOW
+  TransmitInterruptMask interruptMask;
+#else
+  HalAtomicState oldSREG = transmitBegin();
+  if (!transformed) {
+    sendFrame(buffer, pixels * bytesPerPixel);
+    transmitEnd(oldSREG);
+    return;
+  }
+#endif
+  const uint8_t * source = buffer;
+  uint8_t pixel[bytesPerPixel];
+  for (uint8_t i = 0; i < pixels; i++) {
+    const uint8_t * data = source;
+    if (transformed) {
+      for (uint8_t j = 0; j < bytesPerPixel; j++)
+        pixel[j] = outputByte(source[j]);
+      data = pixel;
+    }
+#ifdef HW_NEOPIXEL_INTERRUPT_WINDOW
+    HalAtomicState oldSREG = transmitBegin();
+    sendFrame(data, bytesPerPixel);
+    transmitEnd(oldSREG); // Pending interrupts are serviced here
+#else
+    sendFrame(data, bytesPerPixel);
+#endif
+    source += bytesPerPixel;
+  }
+#ifndef HW_NEOPIXEL_INTERRUPT_WINDOW
+  transmitEnd(oldSREG);
+#endif
 }
 
+#endif
@@ -17,6 +17,10 @@
 
 #include <Arduino.h>
 
+#include "hardware.h"
+#include "hsv.h"
+#include "profiler.h"
+
 /// @defgroup neopixel Array of neopixels (WS2812).
 /// @brief Allows controlling array of neopixels.
 ///
@@ -28,103 +32,537 @@
 
 /// @brief Used for the fast control of neopixel array
 /// 
-/// 
+/// Colours of all neopixels are kept in a frame buffer which is stored in the wire
+/// order (green, red, blue for each neopixel) so that the whole frame is streamed
+/// to the neopixel array from a single contiguous buffer
+///
+/// The frame is only sent to the neopixel array if the frame buffer was actually changed
+/// since the previous update; since neopixels are chained shift registers, only neopixels
+/// up to the last changed one are sent and the rest of neopixels keep their colours
+///
+/// Global brightness (and gamma correction if HW_NEOPIXEL_GAMMA is defined) is applied
+/// to the colour components while they are being sent, the frame buffer always holds
+/// the colours at full brightness
+///
+/// If HW_NEOPIXEL_DITHER is defined, temporal dithering is used to display colour
+/// components with resolution finer than 8 bits
+///
+/// If HW_NEOPIXEL_POWER_LIMIT is defined, sum of the colour components in the frame buffer
+/// is kept up to date by setPixel(); update() uses it to estimate the neopixel current and
+/// reduces brightness of the whole frame if the estimate exceeds HW_NEOPIXEL_POWER_BUDGET
+///
+/// If HW_NEOPIXEL_STREAMING is defined, there is no frame buffer; the whole frame is
+/// generated by stream() while it is being sent
+///
 class Neopixel {
   public:
+    Neopixel();
     void begin(void);
+#ifndef HW_NEOPIXEL_STREAMING
     void setUniformColour(uint8_t r, uint8_t g, uint8_t b);
     void setFromArray(uint8_t r[], uint8_t g[], uint8_t b[]);
+    void setFromHsv(const HsvColour pixels[]);
+  public:
+    inline void setPixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+    inline void setPixel(uint8_t index, const HsvColour & colour);
+    void setRange(uint8_t first, uint8_t number, uint8_t r, uint8_t g, uint8_t b);
+    uint8_t * writePixels(uint8_t first, uint8_t number);
+#endif
+    void setBrightness(uint8_t brightness);
+#ifndef HW_NEOPIXEL_STREAMING
+    void update(void);
+#else
+    template <class Generator> inline void stream(Generator & generator);
+    inline void outputPixel(uint8_t r, uint8_t g, uint8_t b, uint8_t pixel[]);
+#endif
+  private:
+    static const uint8_t bytesPerPixel = 3;               ///< Bytes per neopixel in the frame buffer
+    static const uint8_t offsetGreen = 0;                 ///< Offset of the green component within the pixel
+    static const uint8_t offsetRed = 1;                   ///< Offset of the red component within the pixel
+    static const uint8_t offsetBlue = 2;                  ///< Offset of the blue component within the pixel
+    static const uint16_t frameSize = HW_NEOPIXEL_NUMBER * bytesPerPixel; ///< Frame buffer size in bytes
+    static const uint16_t outputScaleMax = 256;          ///< Output scale which leaves colour components unchanged
+    /// Minimum time between frames in microseconds, gap is measured with micros() which has resolution of 64 CPU cycles
+    static const uint8_t latchMicros = (HW_NEOPIXEL_RES / 1000UL) + 1 + (64 / clockCyclesPerMicrosecond());
+#if HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_UART
+    /// Time to shift out a single UART frame (start bit, 6 data bits, stop bit) in microseconds, rounded up
+    static const uint8_t uartFrameMicros = (8 * 1000000UL + HW_NEOPIXEL_UART_BAUD - 1) / HW_NEOPIXEL_UART_BAUD;
+#endif
+  private:
+#ifndef HW_NEOPIXEL_STREAMING
+    uint8_t frame[frameSize];    ///< Frame buffer in wire order (GRB)
+    volatile uint8_t changedPixels;  ///< Number of leading neopixels which include all neopixels changed since the last update
+#endif
+    uint32_t latchStartTime;     ///< micros() value at the end of the previous frame
+    uint16_t outputScale;        ///< Scale applied to the colour components on output, range 1..outputScaleMax
+#ifdef HW_NEOPIXEL_DITHER
+    uint8_t output[frameSize];       ///< Frame transformed for output to the neopixels
+    uint8_t ditherError[frameSize];  ///< Accumulated fractional parts of the colour components
+    uint16_t ditherScale;            ///< Scale applied to the colour components on output, 0.16 fixed point less one
+    bool ditherActive;               ///< True if the previous frame had colour components with fractional parts
+#endif
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+    uint16_t brightnessScale;        ///< Scale set by setBrightness(), output scale is reduced from it by power limit
+#ifdef HW_NEOPIXEL_DITHER
+    uint16_t brightnessDitherScale;  ///< Dither scale set by setBrightness(), reduced by power limit in the same way
+#endif
+    uint32_t channelLoad;            ///< Sum of colour components in the frame buffer, gamma-corrected if HW_NEOPIXEL_GAMMA is defined
+    uint8_t loadPendingFirst;        ///< First neopixel written through writePixels() and not yet added to channelLoad
+    uint8_t loadPendingNumber;       ///< Number of neopixels written through writePixels() and not yet added to channelLoad
+#endif
   private:
-    inline void sendBit(bool bitVal);
-    inline void sendByte(uint8_t input);
-    inline void sendRgb(uint8_t r, uint8_t g, uint8_t b);
+    inline bool isOutputTransformed(void);
+    inline uint8_t outputByte(uint8_t input);
+    inline HalAtomicState transmitBegin(void);
+    inline void transmitEnd(HalAtomicState oldSREG);
+#ifdef HW_NEOPIXEL_DITHER
+    void ditherFrame(uint8_t pixels);
+#endif
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+    inline uint8_t componentLoad(uint8_t input);
+    uint32_t rangeLoad(uint8_t first, uint8_t number);
+    void settleLoad(void);
+    bool limitPower(void);
+#endif
+#ifndef HW_NEOPIXEL_STREAMING
+    void transmit(const uint8_t * buffer, uint8_t pixels, bool transformed);
+#endif
+    inline void sendFrame(const uint8_t * data, uint16_t size);
     inline void show(void);
+    inline void waitLatch(void);
 };
 
+#ifdef HW_NEOPIXEL_INTERRUPT_WINDOW
+/// @brief Masks interrupt sources whose handlers do not fit into the gap between two neopixels
+///
+/// Declared for the duration of the frame transmission, the sources are unmasked at the end
+/// of the enclosing scope; see HW_NEOPIXEL_INTERRUPT_WINDOW for the masked sources. Only the
+/// interrupt enable bits which were set are cleared and set again, interrupt flags are
+/// not touched
+class TransmitInterruptMask {
+  public:
+    inline TransmitInterruptMask();
+    inline ~TransmitInterruptMask();
+  private:
+#ifdef HW_PROFILE_ATTINY85
+    uint8_t timers;         ///< Masked bits of TIMSK (scheduler tick and Timer0 overflow)
+#else
+    uint8_t timer0;         ///< Masked bits of TIMSK0 (Timer0 overflow)
+    uint8_t timer1;         ///< Masked bits of TIMSK1 (scheduler tick)
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+    uint8_t telemetry;      ///< Masked bits of UCSR0B (telemetry transmit)
+#endif
+#endif
+};
+#endif
+
 /// @}
 
+#ifdef HW_NEOPIXEL_GAMMA
+extern const uint8_t gammaTable[256] PROGMEM;
+#endif
+
+#if defined(HW_NEOPIXEL_STREAMING) && defined(HW_NEOPIXEL_DITHER)
+#error "HW_NEOPIXEL_DITHER requires frame buffer and cannot be used with HW_NEOPIXEL_STREAMING"
+#endif
+
+#if defined(HW_NEOPIXEL_STREAMING) && defined(HW_NEOPIXEL_POWER_LIMIT)
+#error "HW_NEOPIXEL_POWER_LIMIT requires frame buffer and cannot be used with HW_NEOPIXEL_STREAMING"
+#endif
+
+#if defined(HW_NEOPIXEL_POWER_LIMIT) && (HW_NEOPIXEL_POWER_BUDGET <= (HW_NEOPIXEL_IDLE_CURRENT * HW_NEOPIXEL_NUMBER))
+#error "HW_NEOPIXEL_POWER_BUDGET does not cover idle current of HW_NEOPIXEL_NUMBER neopixels"
+#endif
+
+#if defined(HW_PROFILE_ATTINY85) && (HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_SPI)
+#error "SPI neopixel backend is not available on ATtiny85"
+#endif
+
+#if defined(HW_PROFILE_ESP8266) != (HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_UART)
+#error "UART neopixel backend is the only one available on ESP8266 and is not available elsewhere"
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // Neopixel inline methods
 //////////////////////////////////////////////////////////////////////
 
-/// @brief Sends a single bit to neopixel array
-/// @param bitValue Bit to send
-/// @warning The interrupts must be turned off when the 0 bit is being sent 
-/// (HW_NEOPIXEL_T0H + HW_NEOPIXEL_T0L, ~1 us)
-/// @warning Total time of interrupts and time of pixel generation must not exceed reset 
-/// time (HW_NEOPIXEL_RES, ~5 us)
-void Neopixel::sendBit(bool bitValue) {
-  if (bitValue) {//bit value 0
-    asm volatile (
-      "sbi %[port], %[bit] \n\t"        // Set the output bit
-      ".rept %[onCycles] \n\t"          // Execute NOPs to delay exactly the specified number of cycles
-      "nop \n\t"
-      ".endr \n\t"
-      "cbi %[port], %[bit] \n\t"        // Clear the output bit
-      ".rept %[offCycles] \n\t"         // Execute NOPs to delay exactly the specified number of cycles
-      "nop \n\t"
-      ".endr \n\t"
-      ::
-      [port] "I" (_SFR_IO_ADDR(HW_NEOPIXEL_PORT)),
-      [bit] "I" (HW_NEOPIXEL_BIT),
-      //1-bit width less overhead  for the actual bit setting
-      //Note that this delay could be longer and everything would still work
-      [onCycles] "I" (NS_TO_CYCLES(HW_NEOPIXEL_T1H) - 2),
-      //Minimum interbit delay. Note that we probably don't need this at all
-      //since the loop overhead will be enough
-      [offCycles] "I" (NS_TO_CYCLES(HW_NEOPIXEL_T1L) - 2)
-    );
-  }
-  else {//bit value 1
-    //time-critical code
-    //disable interrupts here if they are not disabled outside this method
-    asm volatile (
-      "sbi %[port], %[bit] \n\t"                              // Set the output bit
-      ".rept %[onCycles] \n\t"                                // Now timing actually matters. The 0-bit must be long enough to be detected but not too long or it will be a 1-bit
-      "nop \n\t"                                              // Execute NOPs to delay exactly the specified number of cycles
-      ".endr \n\t"
-      "cbi %[port], %[bit] \n\t"                              // Clear the output bit
-      ".rept %[offCycles] \n\t"                               // Execute NOPs to delay exactly the specified number of cycles
-      "nop \n\t"
-      ".endr \n\t"
-      ::
-      [port] "I" (_SFR_IO_ADDR(HW_NEOPIXEL_PORT)),
-      [bit] "I" (HW_NEOPIXEL_BIT),
-      [onCycles] "I" (NS_TO_CYCLES(HW_NEOPIXEL_T0H) - 2),
-      [offCycles] "I" (NS_TO_CYCLES(HW_NEOPIXEL_T0L) - 2)
-    );
-    //enable interrupts if disabled previously
+/// @brief Cycles spent in the high part of the bit when 0 is sent, less the overhead of instructions
+#define NEOPIXEL_ZERO_CYCLES (NS_TO_CYCLES(HW_NEOPIXEL_T0H) - 3)
+/// @brief Additional cycles spent in the high part of the bit when 1 is sent, less the overhead of instructions
+#define NEOPIXEL_ONE_CYCLES (NS_TO_CYCLES(HW_NEOPIXEL_T1H) - NS_TO_CYCLES(HW_NEOPIXEL_T0H) - 1)
+/// @brief Cycles spent in the low part of the bit, less the overhead of instructions
+#define NEOPIXEL_LOW_CYCLES (NS_TO_CYCLES(HW_NEOPIXEL_TBIT) - NS_TO_CYCLES(HW_NEOPIXEL_T1H) - 6)
+
+#if HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_BITBANG
+
+#if (NEOPIXEL_ZERO_CYCLES < 0) || (NEOPIXEL_ONE_CYCLES < 0) || (NEOPIXEL_LOW_CYCLES < 0)
+#error "Neopixel timings in hardware.h are too short for this F_CPU"
+#endif
+
+/// @brief Sends a buffer of pre-ordered colour components to neopixel array
+///
+/// The whole buffer is sent by a single cycle-counted loop, each bit takes
+/// NS_TO_CYCLES(HW_NEOPIXEL_TBIT) cycles (0 bits take one extra cycle in the low part),
+/// which is 20 cycles or 30 us per neopixel @ 16 MHz
+///
+/// @param data Pointer to the first byte to send
+/// @param size Number of bytes to send
+/// @warning The interrupts must be turned off while the buffer is being sent
+void Neopixel::sendFrame(const uint8_t * data, uint16_t size) {
+  //Neopixel rgb components order is green then red then blue, the buffer is already in this order
+  //Neopixel wants bit in highest-to-lowest order
+  if (!size) return;
+  uint8_t currentByte, bitCounter;
+  asm volatile (
+    "ld   %[byte], %a[ptr]+ \n\t"       // Load the first byte
+    "ldi  %[bits], 8 \n\t"
+    "1: \n\t"
+    "sbi  %[port], %[bit] \n\t"         // Set the output bit, every bit starts here
+    ".rept %[zeroCycles] \n\t"          // Execute NOPs to delay exactly the specified number of cycles
+    "nop \n\t"
+    ".endr \n\t"
+    "sbrs %[byte], 7 \n\t"              // If 0 is being sent...
+    "cbi  %[port], %[bit] \n\t"         // ...clear the output bit here (T0H)
+    ".rept %[oneCycles] \n\t"
+    "nop \n\t"
+    ".endr \n\t"
+    "cbi  %[port], %[bit] \n\t"         // If 1 is being sent, clear the output bit here (T1H)
+    ".rept %[lowCycles] \n\t"
+    "nop \n\t"
+    ".endr \n\t"
+    "lsl  %[byte] \n\t"                 // Next bit
+    "dec  %[bits] \n\t"
+    "brne 1b \n\t"
+    "sbiw %[count], 1 \n\t"             // Next byte; the gap is longer here but still well below reset time
+    "breq 2f \n\t"
+    "ld   %[byte], %a[ptr]+ \n\t"
+    "ldi  %[bits], 8 \n\t"
+    "rjmp 1b \n\t"
+    "2: \n\t"
+    :
+    [byte] "=&r" (currentByte),
+    [bits] "=&d" (bitCounter),
+    [ptr] "+e" (data),
+    [count] "+w" (size)
+    :
+    [port] "I" (_SFR_IO_ADDR(HW_NEOPIXEL_PORT)),
+    [bit] "I" (HW_NEOPIXEL_BIT),
+    [zeroCycles] "I" (NEOPIXEL_ZERO_CYCLES),
+    [oneCycles] "I" (NEOPIXEL_ONE_CYCLES),
+    [lowCycles] "I" (NEOPIXEL_LOW_CYCLES)
+    :
+    "memory"
+  );
+}
+
+#elif HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_SPI
+
+/// @brief SPI symbol for two neopixel bits, each neopixel bit is encoded as 4 SPI bits
+///
+/// Neopixel bit 0 is encoded as SPI bits 1000 and neopixel bit 1 is encoded as SPI bits 1110,
+/// with SPI clock of 4 MHz this gives neopixel bit width of 1 us and high part width of
+/// 250 ns and 750 ns respectively
+///
+/// @param bits Byte whose two highest bits are to be encoded
+#define NEOPIXEL_SPI_SYMBOL(bits) (0x88 | (((bits) & 0x80) ? 0x60 : 0) | (((bits) & 0x40) ? 0x06 : 0))
+
+/// @brief Sends a buffer of pre-ordered colour components to neopixel array
+///
+/// Each byte of the buffer is sent as 4 SPI bytes; SPI hardware paces the neopixel bits and
+/// CPU only feeds SPI data register. The gap between SPI bytes only lengthens the low part of
+/// the neopixel bit, thus interrupts do not need to be disabled as long as interrupt handlers
+/// take less than HW_NEOPIXEL_RES
+///
+/// @param data Pointer to the first byte to send
+/// @param size Number of bytes to send
+void Neopixel::sendFrame(const uint8_t * data, uint16_t size) {
+  //Neopixel rgb components order is green then red then blue, the buffer is already in this order
+  //Neopixel wants bit in highest-to-lowest order, SPI is set up to send MSB first
+  static const uint8_t symbolsPerByte = 4;
+  bool firstSymbol = true;
+  while (size--) {
+    uint8_t currentByte = *data++;
+    for (uint8_t i = 0; i < symbolsPerByte; i++) {
+      uint8_t symbol = NEOPIXEL_SPI_SYMBOL(currentByte);
+      currentByte <<= 2;
+      if (!firstSymbol) {
+        while (!(SPSR & _BV(SPIF)));
+      }
+      SPDR = symbol;
+      firstSymbol = false;
+    }
   }
+  while (!(SPSR & _BV(SPIF)));
 }
 
-/// @brief Sends a byte to neopixel array
-/// @param input Byte to send
-void Neopixel::sendByte(uint8_t input) {
-  // Note that the inter-bit gap can be as long as you want as long as it doesn't exceed the 5us reset timeout (which is a long time)
-  // Here I have been generous and not tried to squeeze the gap tight but instead erred on the side of lots of extra time.
-  // Neopixel wants bit in highest-to-lowest order
-  for (uint8_t bit = 0; bit < 8; bit++) {
-    sendBit(bitRead(input, 7));
-    input <<= 1;
+#elif HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_UART
+
+/// @brief Sends a buffer of pre-ordered colour components to neopixel array
+///
+/// UART1 runs at HW_NEOPIXEL_UART_BAUD in 6N1 mode with inverted TX, so that idle line is low
+/// and each 8-bit UART frame (start bit, 6 data bits, stop bit) carries two neopixel bits of
+/// 4 UART bits each; the inverted start bit is the beginning of the first neopixel bit.
+/// UART hardware paces the neopixel bits and CPU only feeds UART FIFO, thus interrupts
+/// (including WiFi) do not disturb the timings as long as the FIFO does not run empty for
+/// longer than HW_NEOPIXEL_RES. This method returns as soon as the data are in the FIFO,
+/// show() waits until they are shifted out
+///
+/// @param data Pointer to the first byte to send
+/// @param size Number of bytes to send
+void Neopixel::sendFrame(const uint8_t * data, uint16_t size) {
+  //Neopixel rgb components order is green then red then blue, the buffer is already in this order
+  //Neopixel wants bit in highest-to-lowest order, UART sends LSB first: symbols are indexed by
+  //two neopixel bits, 0 is sent as high-low-low-low and 1 as high-high-high-low
+  static const uint8_t symbols[4] = {0b110111, 0b000111, 0b110100, 0b000100};
+  static const uint8_t symbolsPerByte = 4;
+  static const uint8_t fifoSize = 128;
+  while (size--) {
+    uint8_t currentByte = *data++;
+    while (((USS(UART1) >> USTXC) & 0xff) > (fifoSize - symbolsPerByte));
+    for (uint8_t i = 0; i < symbolsPerByte; i++) {
+      USF(UART1) = symbols[currentByte >> 6];
+      currentByte <<= 2;
+    }
   }
 }
 
-/// @brief Sends a single RGB triplet to neopixel array
+#else
+#error "Unknown HW_NEOPIXEL_BACKEND"
+#endif
+
+#ifndef HW_NEOPIXEL_STREAMING
+
+/// @brief Sets colour of a single neopixel in the frame buffer
+///
+/// The neopixels are not updated until update() is called; if the new colour is the same as
+/// the colour already in the frame buffer, the neopixel is not marked as changed
+///
+/// If HW_NEOPIXEL_POWER_LIMIT is defined, difference between the new and the old colour is
+/// added to the sum of colour components
+///
+/// @param index Index of the neopixel, range 0..HW_NEOPIXEL_NUMBER-1
 /// @param r Red component, range 0..255
 /// @param g Green component, range 0..255
 /// @param b Blue component, range 0..255
-void Neopixel::sendRgb(uint8_t r, uint8_t g, uint8_t b) {
-  //Neopixel rgb components order is green then red then blue
-  sendByte(g);
-  sendByte(r);
-  sendByte(b);
+void Neopixel::setPixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+  if (index >= HW_NEOPIXEL_NUMBER) return;
+  uint8_t * pixel = &frame[index * bytesPerPixel];
+  if ((pixel[offsetGreen] == g) && (pixel[offsetRed] == r) && (pixel[offsetBlue] == b)) return;
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+  if (loadPendingNumber) settleLoad();
+  channelLoad += (uint16_t)componentLoad(g) + componentLoad(r) + componentLoad(b);
+  channelLoad -= (uint16_t)componentLoad(pixel[offsetGreen]) + componentLoad(pixel[offsetRed]) + componentLoad(pixel[offsetBlue]);
+#endif
+  pixel[offsetGreen] = g;
+  pixel[offsetRed] = r;
+  pixel[offsetBlue] = b;
+  if (changedPixels <= index) changedPixels = index + 1;
+}
+
+/// @brief Sets colour of a single neopixel in the frame buffer from HSV colour
+///
+/// The neopixels are not updated until update() is called
+///
+/// @param index Index of the neopixel, range 0..HW_NEOPIXEL_NUMBER-1
+/// @param colour Colour of the neopixel
+void Neopixel::setPixel(uint8_t index, const HsvColour & colour) {
+  uint8_t r, g, b;
+  hsvToRgb(colour, r, g, b);
+  setPixel(index, r, g, b);
+}
+
+#else
+
+/// @brief Generates and sends the whole frame, then latches it
+///
+/// The generator converts the colours to output bytes with outputPixel() before the
+/// transmission starts, so global brightness and gamma correction are applied in the same
+/// way as with the frame buffer. Between two neopixels only the output bytes of the next
+/// neopixel are requested from the generator. The frame is sent every time this method
+/// is called
+///
+/// Cycle budget of the gap between two neopixels: HW_NEOPIXEL_RES is 6 us, i.e. 96 CPU
+/// cycles at 16 MHz; ColumnFrame::pixel() (one PROGMEM column lookup plus address
+/// arithmetic) and the loop take about 20 cycles, the rest is left for the interrupt
+/// handlers if HW_NEOPIXEL_INTERRUPT_WINDOW is defined
+///
+/// @tparam Generator Class providing prepare(neopixel), which converts the frame with
+/// outputPixel(), and pixel(index), which returns pointer to the neopixel's output bytes
+/// @param generator Generator of neopixel colours, pixel() is called for indexes
+/// 0..HW_NEOPIXEL_NUMBER-1 in order
+/// @warning Generator's pixel() (and interrupt handlers if HW_NEOPIXEL_INTERRUPT_WINDOW is
+/// defined) run in the gap between two neopixels and must take less than HW_NEOPIXEL_RES,
+/// otherwise the frame is latched prematurely
+/// @warning This method must not be re-entered, see update()
+template <class Generator>
+void Neopixel::stream(Generator & generator) {
+  generator.prepare(*this);
+  waitLatch();
+  PROFILE_SCOPE(PROFILE_TRANSMIT);
+#ifdef HW_NEOPIXEL_INTERRUPT_WINDOW
+  TransmitInterruptMask interruptMask;
+#else
+  HalAtomicState oldSREG = transmitBegin();
+#endif
+  for (uint8_t i = 0; i < HW_NEOPIXEL_NUMBER; i++) {
+    const uint8_t * pixel = generator.pixel(i);
+#ifdef HW_NEOPIXEL_INTERRUPT_WINDOW
+    HalAtomicState oldSREG = transmitBegin();
+    sendFrame(pixel, bytesPerPixel);
+    transmitEnd(oldSREG); // Pending interrupts are serviced here
+#else
+    sendFrame(pixel, bytesPerPixel);
+#endif
+  }
+#ifndef HW_NEOPIXEL_INTERRUPT_WINDOW
+  transmitEnd(oldSREG);
+#endif
+  show();
+}
+
+/// @brief Converts colour of the neopixel to output bytes, called by the stream() generator
+///
+/// Applies gamma correction (if enabled) and global brightness and stores the result in
+/// the wire order
+///
+/// @param r Red component at full brightness, range 0..255
+/// @param g Green component at full brightness, range 0..255
+/// @param b Blue component at full brightness, range 0..255
+/// @param pixel Receives bytesPerPixel output bytes
+void Neopixel::outputPixel(uint8_t r, uint8_t g, uint8_t b, uint8_t pixel[]) {
+  if (isOutputTransformed()) {
+    r = outputByte(r);
+    g = outputByte(g);
+    b = outputByte(b);
+  }
+  pixel[offsetGreen] = g;
+  pixel[offsetRed] = r;
+  pixel[offsetBlue] = b;
+}
+
+#endif
+
+/// @brief Checks whether colour components need to be transformed on output
+/// @return True if gamma correction or brightness are to be applied to the frame
+bool Neopixel::isOutputTransformed(void) {
+#ifdef HW_NEOPIXEL_GAMMA
+  return (true);
+#else
+  return (outputScale != outputScaleMax);
+#endif
+}
+
+/// @brief Applies gamma correction (if enabled) and global brightness to the colour component
+/// @param input Colour component from the frame buffer
+/// @return Colour component to be sent to the neopixels
+uint8_t Neopixel::outputByte(uint8_t input) {
+#ifdef HW_NEOPIXEL_GAMMA
+  input = pgm_read_byte(&gammaTable[input]);
+#endif
+  return (((uint16_t)input * outputScale) >> 8);
+}
+
+#ifdef HW_NEOPIXEL_POWER_LIMIT
+/// @brief Calculates contribution of the colour component to the neopixel current
+/// @param input Colour component from the frame buffer
+/// @return Colour component at full brightness as it is sent to the neopixels
+uint8_t Neopixel::componentLoad(uint8_t input) {
+#ifdef HW_NEOPIXEL_GAMMA
+  return (pgm_read_byte(&gammaTable[input]));
+#else
+  return (input);
+#endif
+}
+#endif
+
+/// @brief Prepares for the neopixel data transmission
+///
+/// With bit-bang backend interrupts are disabled, with SPI and UART backends interrupts
+/// do not disturb the neopixel timings and stay enabled
+///
+/// @return Interrupt state to be passed to transmitEnd()
+HalAtomicState Neopixel::transmitBegin(void) {
+#if HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_BITBANG
+  return (halAtomicBegin());
+#else
+  return (0);
+#endif
+}
+
+/// @brief Restores interrupts state saved by transmitBegin()
+/// @param oldSREG Value returned by transmitBegin()
+void Neopixel::transmitEnd(HalAtomicState oldSREG) {
+#if HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_BITBANG
+  halAtomicEnd(oldSREG);
+#else
+  (void)oldSREG;
+#endif
 }
 
 /// @brief Makes neopixels actually display the RGB values previously sent to them
+///
+/// Neopixels latch the frame when the data line stays low for HW_NEOPIXEL_RES, this method
+/// does not wait but only records the time when the frame ended, see waitLatch()
+///
+/// With UART backend the frame ends when the last UART frame leaves the shift register;
+/// the FIFO count drops to zero when the last UART frame is moved to the shift register,
+/// so one more UART frame time is waited
 void Neopixel::show(void) {
-  // Delay must be AT LEAST this long (too short might not work, too long not a problem)
-  const uint32_t nanosecPerMiscrosec = 1000UL;
-  delayMicroseconds((HW_NEOPIXEL_RES / nanosecPerMiscrosec) + 1);
+#if HW_NEOPIXEL_BACKEND == HW_NEOPIXEL_BACKEND_UART
+  while ((USS(UART1) >> USTXC) & 0xff);
+  delayMicroseconds(uartFrameMicros);
+#endif
+  latchStartTime = micros();
 }
 
+/// @brief Waits until the previous frame is latched by neopixels
+///
+/// Delay is only needed if the new frame is started sooner than HW_NEOPIXEL_RES after the
+/// end of the previous frame (too short might not work, too long not a problem)
+void Neopixel::waitLatch(void) {
+  while ((micros() - latchStartTime) < latchMicros);
+}
+
+#ifdef HW_NEOPIXEL_INTERRUPT_WINDOW
+
+//////////////////////////////////////////////////////////////////////
+// TransmitInterruptMask inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Masks the interrupt sources which are enabled
+TransmitInterruptMask::TransmitInterruptMask() {
+  HalAtomicState oldSREG = halAtomicBegin();
+#ifdef HW_PROFILE_ATTINY85
+  timers = TIMSK & (_BV(OCIE1A) | _BV(TOIE0));
+  TIMSK &= ~timers;
+#else
+  timer0 = TIMSK0 & _BV(TOIE0);
+  TIMSK0 &= ~timer0;
+  timer1 = TIMSK1 & _BV(OCIE1A);
+  TIMSK1 &= ~timer1;
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+  telemetry = UCSR0B & _BV(UDRIE0);
+  UCSR0B &= ~telemetry;
+#endif
+#endif
+  halAtomicEnd(oldSREG);
+}
+
+/// @brief Unmasks the interrupt sources masked by constructor, pending interrupts are serviced afterwards
+TransmitInterruptMask::~TransmitInterruptMask() {
+  HalAtomicState oldSREG = halAtomicBegin();
+#ifdef HW_PROFILE_ATTINY85
+  TIMSK |= timers;
+#else
+  TIMSK0 |= timer0;
+  TIMSK1 |= timer1;
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+  UCSR0B |= telemetry;
+#endif
+#endif
+  halAtomicEnd(oldSREG);
+}
+
+#endif
+
 #endif // #ifndef NEOPIXEL_H
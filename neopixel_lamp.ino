@@ -8,33 +8,133 @@
 /// @file
 /// @brief Main program.
 ///
-/// @warning Current version was only tested with Arduino Nano V3 (ATMega328)
-/// @todo Also add support for ATTiny
+/// @warning Current version was only tested with Arduino Nano V3 (ATMega328); ATtiny85
+/// profile (see hardware.h) renders neopixels without frame buffer and only supports
+/// effects whose colour is the same along each column; on ESP8266 frames are rendered
+/// by the main loop rather than by the scheduler's interrupt and may be received over WiFi
 
 #include "version.h"
 #include "hardware.h"
 
+#ifndef HW_PROFILE_ESP8266
+#include <avr/sleep.h>
+#endif
+
 #include "rotenc.h"
 #include "neopixel.h"
+#include "scheduler.h"
+#include "colour.h"
+#include "effects.h"
+#include "matrix.h"
+#include "transition.h"
+#include "telemetry.h"
+#include "profiler.h"
+#include "storage.h"
+#include "columnframe.h"
+#include "parallel.h"
+#include "network.h"
 
-#define DEBUG ///< Declaring this macro enables debug output to the serial port
-
-RotEnc rotenc;
+RotEncSampler<HW_ROTENC_PORT> rotencSampler;
+RotEnc<HW_ROTENC_PORT, HW_ROTENC_A_BIT, HW_ROTENC_B_BIT, HW_ROTENC_BTN_BIT, HW_ROTENC_CYCLES_PER_DETENT> rotenc;
+#ifdef HW_ROTENC_BRIGHTNESS
+#ifdef HW_PROFILE_ESP8266
+RotEncSampler<HW_ROTENC_BRIGHTNESS_PORT> brightnessRotencSampler;   ///< Brightness encoder pins are not in HW_ROTENC_PORT
+#endif
+RotEnc<HW_ROTENC_BRIGHTNESS_PORT, HW_ROTENC_BRIGHTNESS_A_BIT, HW_ROTENC_BRIGHTNESS_B_BIT, HW_ROTENC_BRIGHTNESS_BTN_BIT, HW_ROTENC_CYCLES_PER_DETENT> brightnessRotenc;
+#endif
+#ifdef HW_NEOPIXEL_PARALLEL
+ParallelNeopixel neopixel;
+#else
 Neopixel neopixel;
+#endif
+Scheduler scheduler;
+Storage storage;
+#ifdef HW_NETWORK
+Network network;
+#endif
 
+#ifdef HW_NEOPIXEL_STREAMING
+ColumnFrame<HW_NEOPIXEL_COLS> columnFrame;            ///< Replaces neopixel frame buffer, see HW_NEOPIXEL_STREAMING
+ColumnFrame<HW_NEOPIXEL_COLS> & frameOutput = columnFrame;  ///< Effects and static colour are rendered here
+#elif defined(HW_NEOPIXEL_PARALLEL)
+ParallelNeopixel & frameOutput = neopixel;            ///< Effects and static colour are rendered here
+#else
+Neopixel & frameOutput = neopixel;                    ///< Effects and static colour are rendered here
+#endif
+
+#ifdef HW_PROFILE_ESP8266
+void ICACHE_RAM_ATTR rotencInterrupt(void) {
+  rotencSampler.interruptHandler();
+#ifdef HW_ROTENC_BRIGHTNESS
+  brightnessRotencSampler.interruptHandler();
+#endif
+}
+#else
 ISR (HW_ROTENC_INTVECT) {
-  rotenc.encoderInterruptHandler();
-  rotenc.buttonInterruptHandler();
+  PROFILE_SCOPE(PROFILE_ENCODER_ISR);
+  //Both encoders share the port, see HW_ROTENC_BRIGHTNESS_PORT
+  rotencSampler.interruptHandler();
 }
+#endif
+
+/// @brief Decodes the queued encoder line changes and runs the encoders' tick handlers
+///
+/// Called from the scheduler tick ISR
+void HAL_ISR_CODE rotencTick(void) {
+  uint8_t port;
+  while (rotencSampler.getSample(port)) {
+    rotenc.lineHandler(port);
+#if defined(HW_ROTENC_BRIGHTNESS) && !defined(HW_PROFILE_ESP8266)
+    brightnessRotenc.lineHandler(port);
+#endif
+  }
+#if defined(HW_ROTENC_BRIGHTNESS) && defined(HW_PROFILE_ESP8266)
+  while (brightnessRotencSampler.getSample(port)) brightnessRotenc.lineHandler(port);
+#endif
+  rotenc.tickInterruptHandler();
+#ifdef HW_ROTENC_BRIGHTNESS
+  brightnessRotenc.tickInterruptHandler();
+#endif
+}
+
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+Telemetry telemetry;
+
+ISR (HW_TELEMETRY_INTVECT) {
+  telemetry.interruptHandler();
+}
+
+ISR (HW_TELEMETRY_RX_INTVECT) {
+  telemetry.receiveInterruptHandler();
+}
+#endif
+
+#ifdef HW_PROFILER
+Profiler profiler;
+#endif
+
+void renderFrame(void);
+void applyTransition(void);
+
+#ifdef HW_PROFILE_ESP8266
+volatile bool frameDue = false;   ///< Set by the scheduler tick, frame is rendered by the main loop
 
-#define COLOUR_RESOLUTION 32                                   ///< Hue resolution per primary colour
-#define COLOUR_MAX_HUE (COLOUR_RESOLUTION * 6 - 1)             ///< Maximum hue value
-#define COLOUR_MAX 256                                         ///< Full brightness of any RGB component
-#define COLOUR_OFF 0                                           ///< RGB component is off
-#define COLOUR_FACTOR (COLOUR_MAX/COLOUR_RESOLUTION)           ///< Scale factor to obtain RGB components suitable for neopixels
-#define COLOUR_RAMPDOWN(val,max) ((max - val) * COLOUR_FACTOR) ///< Linear ramp-up of rgb component
-#define COLOUR_RAMPUP(val,min) ((val - min) * COLOUR_FACTOR)   ///< Linear ramp-down of rgb component
-#define COLOUR_MAX_BRIGHTNESS 64                               ///< Max value for brightness
+void ICACHE_RAM_ATTR schedulerInterrupt(void) {
+  rotencTick();
+  if (scheduler.tickInterruptHandler()) frameDue = true;
+}
+#else
+ISR (HW_SCHEDULER_INTVECT) {
+  rotencTick();
+  //Returns false in a tick nested inside the running frame, so the frame is never re-entered
+  if (!scheduler.tickInterruptHandler()) return;
+  //Frame is rendered with interrupts enabled so that rotary encoder and millis() keep running
+  interrupts();
+  renderFrame();
+  noInterrupts();
+  scheduler.frameComplete();
+}
+#endif
 
 uint8_t neopx_red = 0;        ///< Neopixels' calculated red component
 uint8_t neopx_green = 0;      ///< Neopixels' calculated green component
@@ -43,159 +143,421 @@ uint8_t neopx_blue = 0;       ///< Neopixels' calculated blue component
 uint8_t neopx_hue = 52;                             ///< Hue value for neopixels
 uint8_t neopx_brightness = COLOUR_MAX_BRIGHTNESS;   ///< Brightness value for neopixels
 
-/// @brief Calculates RGB colour component for neopixels
-/// @param component Original component value in range COLOUR_OFF..COLOUR_MAX
+/// @brief Calculates neopixels' brightness
 /// @param brightness Brightness value in range 0..COLOUR_MAX_BRIGHTNESS.
-/// @return Calculated component value in range 0..255.
-uint8_t calcColourComponent(uint16_t component, uint8_t brightness) {
-  component = component * (uint16_t)brightness / COLOUR_MAX_BRIGHTNESS;
-  return ((component > 255) ? 255 : component);
+/// @return Brightness value in range 0..255 suitable for Neopixel::setBrightness().
+uint8_t calcBrightness(uint8_t brightness) {
+  return (COLOUR_CLAMP((uint16_t)brightness << (8 - COLOUR_BRIGHTNESS_SHIFT)));
 }
 
-/// @brief Calculates RGB value from hue and stores in neopx_red, neopx_green and neopx_blue.
+/// @brief Calculates RGB value at full brightness from hue and stores in neopx_red, neopx_green and neopx_blue.
+///
+/// Brightness is applied by Neopixel class when the colours are sent to neopixels.
+///
 /// @param hue Hue value in range 0..COLOUR_MAX_HUE.
-/// @param brightness Brightness value in range 0..COLOUR_MAX_BRIGHTNESS.
-void calcRGB(uint8_t hue, uint8_t brightness) {
-  uint16_t r = 0, g = 0, b = 0;
-  if (hue >= COLOUR_MAX_HUE) hue = 0;
-  if (hue < COLOUR_RESOLUTION) {
-    r = COLOUR_MAX;
-    g = COLOUR_OFF;
-    b = COLOUR_RAMPDOWN(hue, COLOUR_RESOLUTION);
-  }
-  if ((hue >= COLOUR_RESOLUTION) && (hue < COLOUR_RESOLUTION * 2)) {
-    r = COLOUR_MAX;
-    g = COLOUR_RAMPUP(hue, COLOUR_RESOLUTION);
-    b = COLOUR_OFF;
+void calcRGB(uint8_t hue) {
+  PROFILE_SCOPE(PROFILE_CALC_RGB);
+  colourFromHue(hue, neopx_red, neopx_green, neopx_blue);
+}
+
+/// Parameter controlled by encoder rotation
+enum ControlParameter {
+  CONTROL_BRIGHTNESS,   ///< Encoder rotation controls brightness
+  CONTROL_HUE,          ///< Encoder rotation controls hue
+  CONTROL_EFFECT,       ///< Encoder rotation selects animated effect
+  CONTROL_DIRECTION,    ///< Encoder rotation selects lit column for directional light
+  CONTROL_NUMBER        ///< Number of parameters controlled by encoder
+};
+
+#ifdef HW_ROTENC_BRIGHTNESS
+#define CONTROL_FIRST CONTROL_HUE           ///< First parameter selectable for the main encoder, brightness has its own encoder
+#else
+#define CONTROL_FIRST CONTROL_BRIGHTNESS    ///< First parameter selectable for the main encoder
+#endif
+
+/// Animated effect
+enum Effect {
+  EFFECT_NONE,          ///< No effect, all neopixels are lit with the same colour
+  EFFECT_RAINBOW,       ///< Rainbow scrolling across the columns
+  EFFECT_BREATHING,     ///< All neopixels fade in and out
+#ifndef HW_NEOPIXEL_STREAMING
+  EFFECT_FIRE,          ///< Fire simulation
+  EFFECT_TWINKLE,       ///< Random neopixels flash and fade out
+#endif
+  EFFECT_NUMBER         ///< Number of effects
+};
+
+ControlParameter controlParameter = CONTROL_FIRST;     ///< Parameter controlled by the main encoder rotation
+bool lampOn = true;                                     ///< True if lamp is on, false if lamp is off.
+volatile uint8_t currentEffect = EFFECT_NONE;           ///< Animated effect currently displayed, see Effect
+uint8_t direction = 0;                                  ///< 0 if all columns are lit, otherwise number of the only lit column (1..HW_NEOPIXEL_COLS)
+
+#define TRANSITION_DURATION 250  ///< Duration of colour and brightness transitions, milliseconds
+#define TRANSITION_FRAMES (TRANSITION_DURATION * HW_SCHEDULER_FRAME_RATE / 1000UL) ///< Duration of transitions in frames
+
+#if TRANSITION_FRAMES > 255
+#error "TRANSITION_DURATION is too long for HW_SCHEDULER_FRAME_RATE"
+#endif
+
+/// Channel interpolated by colour transition
+enum TransitionChannel {
+  TRANSITION_RED,           ///< Red component at full brightness
+  TRANSITION_GREEN,         ///< Green component at full brightness
+  TRANSITION_BLUE,          ///< Blue component at full brightness
+  TRANSITION_BRIGHTNESS,    ///< Brightness, as passed to Neopixel::setBrightness()
+  TRANSITION_NUMBER         ///< Number of interpolated channels
+};
+
+Transition<TRANSITION_NUMBER> transition; ///< Fades neopixels from the displayed colour to the calculated one
+
+RainbowEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> rainbowEffect;
+BreathingEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> breathingEffect;
+#ifndef HW_NEOPIXEL_STREAMING
+FireEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> fireEffect;
+TwinkleEffect<HW_NEOPIXEL_ROWS, HW_NEOPIXEL_COLS> twinkleEffect;
+#endif
+
+///@brief Sets rotary encoders' counter ranges and start values when parameter controlled by encoder changed.
+void updateControl(void) {
+#ifdef HW_ROTENC_BRIGHTNESS
+  brightnessRotenc.setCounter(neopx_brightness, 0, COLOUR_MAX_BRIGHTNESS, false, true);
+#endif
+  switch (controlParameter) {
+    case CONTROL_HUE:
+      rotenc.setCounter(neopx_hue, 0, COLOUR_MAX_HUE, true, true);
+      break;
+    case CONTROL_EFFECT:
+      rotenc.setCounter(currentEffect, 0, EFFECT_NUMBER - 1, true, false);
+      break;
+    case CONTROL_DIRECTION:
+      rotenc.setCounter(direction, 0, HW_NEOPIXEL_COLS, true, false);
+      break;
+    default:
+      rotenc.setCounter(neopx_brightness, 0, COLOUR_MAX_BRIGHTNESS, false, true);
+      break;
   }
-  if ((hue >= COLOUR_RESOLUTION * 2) && (hue < COLOUR_RESOLUTION * 3)) {
-    r = COLOUR_RAMPDOWN(hue, COLOUR_RESOLUTION * 3);
-    g = COLOUR_MAX;
-    b = COLOUR_OFF;
+}
+
+///@brief Calculates and sends a frame to neopixels, called by frame scheduler.
+void renderFrame(void) {
+  PROFILE_SCOPE(PROFILE_RENDER_FRAME);
+#ifdef HW_NETWORK
+  //Frame buffer contains the frame received over network
+  if (network.isActive()) {
+    neopixel.update();
+    return;
   }
-  if ((hue >= COLOUR_RESOLUTION * 3) && (hue < COLOUR_RESOLUTION * 4)) {
-    r = COLOUR_OFF;
-    g = COLOUR_MAX;
-    b = COLOUR_RAMPUP(hue, COLOUR_RESOLUTION * 3);
+#endif
+  bool transitionStep = transition.step();
+  if (transitionStep) applyTransition();
+  switch (currentEffect) {
+    case EFFECT_RAINBOW:
+      rainbowEffect.step();
+      rainbowEffect.render(frameOutput);
+      break;
+    case EFFECT_BREATHING:
+      breathingEffect.step();
+      breathingEffect.render(frameOutput);
+      break;
+#ifndef HW_NEOPIXEL_STREAMING
+    case EFFECT_FIRE:
+      fireEffect.step();
+      fireEffect.render(frameOutput);
+      break;
+    case EFFECT_TWINKLE:
+      twinkleEffect.step();
+      twinkleEffect.render(frameOutput);
+      break;
+#endif
+    default:
+      break;
   }
-  if ((hue >= COLOUR_RESOLUTION * 4) && (hue < COLOUR_RESOLUTION * 5)) {
-    r = COLOUR_OFF;
-    g = COLOUR_RAMPDOWN(hue, COLOUR_RESOLUTION * 5);
-    b = COLOUR_MAX;
+#ifdef HW_NEOPIXEL_STREAMING
+  //Transition may only change brightness which is applied while the frame is sent
+  if (columnFrame.takeChanges() || transitionStep) neopixel.stream(columnFrame);
+#else
+  neopixel.update();
+#endif
+}
+
+///@brief Sets neopixels to the same colour when no effect is displayed.
+///
+///If directional light is selected, only one column is lit.
+void setStaticColour(uint8_t r, uint8_t g, uint8_t b) {
+  if (!direction) {
+    frameOutput.setUniformColour(r, g, b);
+    return;
   }
-  if (hue >= COLOUR_RESOLUTION * 5) {
-    r = COLOUR_RAMPUP(hue, COLOUR_RESOLUTION * 5);
-    g = COLOUR_OFF;
-    b = COLOUR_MAX;
+  for (uint8_t y = 0; y < HW_NEOPIXEL_ROWS; y++) {
+    for (uint8_t x = 0; x < HW_NEOPIXEL_COLS; x++) {
+      if (x == direction - 1)
+        frameOutput.setPixel(matrixIndex(x, y), r, g, b);
+      else
+        frameOutput.setPixel(matrixIndex(x, y), 0, 0, 0);
+    }
   }
-  neopx_red = calcColourComponent(r, brightness);
-  neopx_green = calcColourComponent(g, brightness);
-  neopx_blue = calcColourComponent(b, brightness);
 }
 
-bool controlParameter = false; ///< Parameter controlled by encoder rotation, false for brightness, true for hue
-bool lampOn = true;            ///< True if lamp is on, false if lamp is off.
+///@brief Applies colour and brightness reached by transition, called by frame scheduler.
+void applyTransition(void) {
+  uint8_t r = transition.value(TRANSITION_RED);
+  uint8_t g = transition.value(TRANSITION_GREEN);
+  uint8_t b = transition.value(TRANSITION_BLUE);
+  neopixel.setBrightness(transition.value(TRANSITION_BRIGHTNESS));
+  breathingEffect.setColour(r, g, b);
+#ifndef HW_NEOPIXEL_STREAMING
+  twinkleEffect.setColour(r, g, b);
+#endif
+  if (currentEffect == EFFECT_NONE)
+    setStaticColour(r, g, b);
+}
 
-///@brief Sets rotary encoder counter range and start value when parameter controlled by neopixel changed.
-void updateControl(void) {
-  if (controlParameter) {
-    rotenc.setCounter(neopx_hue, 0, COLOUR_MAX_HUE, true);
-  }
-  else {
-    rotenc.setCounter(neopx_brightness, 0, COLOUR_MAX_BRIGHTNESS, false);
-  }
+///@brief Calculates colour and brightness from hue, brightness and lamp state.
+///@param target Receives values for every TransitionChannel.
+void calcTransitionTarget(uint8_t target[]) {
+  calcRGB(neopx_hue);
+  target[TRANSITION_RED] = neopx_red;
+  target[TRANSITION_GREEN] = neopx_green;
+  target[TRANSITION_BLUE] = neopx_blue;
+  target[TRANSITION_BRIGHTNESS] = lampOn ? calcBrightness(neopx_brightness) : 0;
+}
+
+///@brief Sends restored colour to neopixels without transition, called before anything else is initialised.
+void showFirstFrame(void) {
+  uint8_t target[TRANSITION_NUMBER];
+  calcTransitionTarget(target);
+  transition.set(target);
+  applyTransition();
+  renderFrame();
 }
 
-///@brief Updates neopixels if hue or brightness changed.
+///@brief Starts transition to the new colour if hue or brightness changed, neopixels are updated by the frame scheduler.
 void updateNeopixels(void) {
-  calcRGB(neopx_hue, lampOn ? neopx_brightness : 0);
-  neopixel.setUniformColour(neopx_red, neopx_green, neopx_blue);
-#ifdef DEBUG
-  Serial.print(F("Neopixels updated, RGB: "));
-  Serial.print(neopx_red);
-  Serial.print(F(" / "));
-  Serial.print(neopx_green);
-  Serial.print(F(" / "));
-  Serial.print(neopx_blue);
-  Serial.print(F(", brightness: "));
-  Serial.println(neopx_brightness);
-#endif
+  uint8_t target[TRANSITION_NUMBER];
+  calcTransitionTarget(target);
+  transition.start(target, TRANSITION_FRAMES);
+  TELEMETRY(HW_TELEMETRY_LEVEL_DEBUG, TELEMETRY_ID_RED_GREEN, neopx_red | (neopx_green << 8));
+  TELEMETRY(HW_TELEMETRY_LEVEL_DEBUG, TELEMETRY_ID_BLUE, neopx_blue);
+  TELEMETRY(HW_TELEMETRY_LEVEL_DEBUG, TELEMETRY_ID_BRIGHTNESS, neopx_brightness);
+  TELEMETRY(HW_TELEMETRY_LEVEL_DEBUG, TELEMETRY_ID_EFFECT, currentEffect);
+  TELEMETRY(HW_TELEMETRY_LEVEL_DEBUG, TELEMETRY_ID_DIRECTION, direction);
+}
+
+///@brief Restores lamp state stored in EEPROM, values out of range are ignored.
+void loadLampState(void) {
+  LampState state;
+  if (!storage.begin(state)) return;
+  if (state.hue <= COLOUR_MAX_HUE) neopx_hue = state.hue;
+  if (state.brightness <= COLOUR_MAX_BRIGHTNESS) neopx_brightness = state.brightness;
+  lampOn = state.lampOn;
+  if (state.effect < EFFECT_NUMBER) currentEffect = state.effect;
+  if (state.direction <= HW_NEOPIXEL_COLS) direction = state.direction;
+}
+
+///@brief Schedules lamp state to be stored in EEPROM when encoder is idle.
+void saveLampState(void) {
+  LampState state;
+  state.hue = neopx_hue;
+  state.brightness = neopx_brightness;
+  state.lampOn = lampOn;
+  state.effect = currentEffect;
+  state.direction = direction;
+  storage.save(state);
 }
 
 void setup() {
-#ifdef DEBUG
-  Serial.begin (115200);
-  Serial.print(F("Starting...\nFirmware version "));
-  Serial.print(FIRMWARE_VERSION_MAJOR);
-  Serial.print('.');
-  Serial.println(FIRMWARE_VERSION_MINOR);
-  if (lampOn)
-    Serial.println(F("Lamp on."));
-  else
-    Serial.println(F("Lamp off."));
-  if (controlParameter)
-    Serial.println(F("Rotary Encoder shaft controls hue."));
-  else
-    Serial.println(F("Rotary Encoder shaft controls brightness."));
-   Serial.print(F("Start parameters: hue = "));
-   Serial.print(neopx_hue);
-   Serial.print(F(", brightness = "));
-   Serial.println(neopx_brightness);
+  //Time to first light: restored colour is sent before the rest of the hardware is initialised
+  loadLampState();
+  neopixel.begin();
+  showFirstFrame();
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+  telemetry.begin();
+#endif
+  TELEMETRY(HW_TELEMETRY_LEVEL_INFO, TELEMETRY_ID_STARTUP, (FIRMWARE_VERSION_MAJOR << 8) | FIRMWARE_VERSION_MINOR);
+  TELEMETRY(HW_TELEMETRY_LEVEL_INFO, TELEMETRY_ID_LAMP, lampOn);
+  TELEMETRY(HW_TELEMETRY_LEVEL_INFO, TELEMETRY_ID_CONTROL, controlParameter);
+  TELEMETRY(HW_TELEMETRY_LEVEL_INFO, TELEMETRY_ID_HUE, neopx_hue);
+  TELEMETRY(HW_TELEMETRY_LEVEL_INFO, TELEMETRY_ID_BRIGHTNESS, neopx_brightness);
+#ifndef HW_PROFILE_ESP8266
+  //ADC and analog comparator are not used, disable them to reduce power consumption
+  ADCSRA = 0;
+  ACSR = _BV(ACD);
 #endif
   rotenc.begin();
+#ifdef HW_ROTENC_BRIGHTNESS
+  brightnessRotenc.begin();
+#endif
   updateControl();
-  neopixel.begin();
+#ifdef HW_PROFILE_ESP8266
+  attachInterrupt(digitalPinToInterrupt(HW_ROTENC_PORT::pin(HW_ROTENC_A_BIT)), rotencInterrupt, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(HW_ROTENC_PORT::pin(HW_ROTENC_B_BIT)), rotencInterrupt, CHANGE);
+#ifdef HW_ROTENC_BRIGHTNESS
+  attachInterrupt(digitalPinToInterrupt(HW_ROTENC_BRIGHTNESS_PORT::pin(HW_ROTENC_BRIGHTNESS_A_BIT)), rotencInterrupt, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(HW_ROTENC_BRIGHTNESS_PORT::pin(HW_ROTENC_BRIGHTNESS_B_BIT)), rotencInterrupt, CHANGE);
+#endif
+  timer1_attachInterrupt(schedulerInterrupt);
+#endif
+  scheduler.begin();
+#ifdef HW_NETWORK
+  network.begin();
+#endif
+#ifdef HW_PROFILER
+  profiler.begin();
+#endif
+}
+
+///@brief Selects parameter controlled by the main rotary encoder
+void selectControlParameter(ControlParameter parameter) {
+  controlParameter = parameter;
+  updateControl();
+  TELEMETRY(HW_TELEMETRY_LEVEL_INFO, TELEMETRY_ID_CONTROL, controlParameter);
   updateNeopixels();
 }
 
-void loop() {
-  static int16_t oldCounter = 0;
-  int16_t currCounter = rotenc.getCounter();
-  //Encoder shaft control
-  if (currCounter != oldCounter) {
-#ifdef DEBUG
-    Serial.print(F("Rotary encoder counter: "));
-    Serial.println(currCounter, DEC);
+#ifndef HW_PROFILE_ESP8266
+///@brief Sleeps until the next interrupt.
+///
+///Idle sleep mode is used while the lamp is on (or fading out) so that frame scheduler,
+///millis() and serial port keep running. When the lamp is off and the transition is
+///complete, power-down sleep mode is used; only encoder rotation or button press wakes
+///the MCU up. Button clicks and encoder line changes are decoded by the scheduler tick which
+///is stopped in power-down mode, so idle sleep mode is used after wakeup until the buttons
+///are idle.
+void sleepUntilInterrupt(void) {
+#ifdef HW_ROTENC_BRIGHTNESS
+  bool buttonActive = rotenc.isButtonActive() || brightnessRotenc.isButtonActive();
+#else
+  bool buttonActive = rotenc.isButtonActive();
+#endif
+  bool powerDown = !lampOn && !transition.isRunning() && !buttonActive;
+  if (powerDown) {
+    storage.flush();
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+    telemetry.flush();
+#endif
+    rotenc.setButtonWakeup(true);
+#ifdef HW_ROTENC_BRIGHTNESS
+    brightnessRotenc.setButtonWakeup(true);
+#endif
+  }
+  set_sleep_mode(powerDown ? SLEEP_MODE_PWR_DOWN : SLEEP_MODE_IDLE);
+  //Interrupts are disabled so that event queued after the check does not wait for the next wakeup
+  noInterrupts();
+#ifdef HW_ROTENC_BRIGHTNESS
+  bool eventQueued = rotenc.isEventQueued() || brightnessRotenc.isEventQueued();
+#else
+  bool eventQueued = rotenc.isEventQueued();
+#endif
+  if (!eventQueued) {
+    sleep_enable();
+    if (powerDown) sleep_bod_disable();
+    interrupts();
+    sleep_cpu();
+    sleep_disable();
+  }
+  interrupts();
+  if (powerDown) {
+    rotenc.setButtonWakeup(false);
+#ifdef HW_ROTENC_BRIGHTNESS
+    brightnessRotenc.setButtonWakeup(false);
+#endif
+  }
+}
+#endif
+
+///@brief Applies rotary encoder event to the lamp state.
+///
+///Brightness encoder (if HW_ROTENC_BRIGHTNESS is defined) always controls brightness; long click
+///and double click only select parameter controlled by the main encoder.
+///@param event Event retrieved from the encoder.
+///@param brightnessEncoder True if event comes from the brightness encoder.
+void handleEvent(const RotEncBase::Event & event, bool brightnessEncoder) {
+#ifdef HW_NETWORK
+  //Rotary encoder takes neopixels back from the network
+  network.override();
 #endif
+  if (event.type != RotEncBase::EVENT_COUNTER)
+    TELEMETRY(HW_TELEMETRY_LEVEL_DEBUG, TELEMETRY_ID_BUTTON, event.type);
+  //Encoder shaft control
+  if (event.type == RotEncBase::EVENT_COUNTER) {
+    TELEMETRY(HW_TELEMETRY_LEVEL_DEBUG, TELEMETRY_ID_COUNTER, event.counter);
     if (lampOn) {
-      if (controlParameter)
-        neopx_hue = currCounter;
-      else
-        neopx_brightness = currCounter;
+      switch (brightnessEncoder ? CONTROL_BRIGHTNESS : controlParameter) {
+        case CONTROL_HUE:
+          neopx_hue = event.counter;
+          break;
+        case CONTROL_EFFECT:
+          currentEffect = event.counter;
+          break;
+        case CONTROL_DIRECTION:
+          direction = event.counter;
+          break;
+        default:
+          neopx_brightness = event.counter;
+          break;
+      }
       updateNeopixels();
     }
     else {
       updateControl();
     }
-    oldCounter = currCounter;
   }
   //Encoder button control
-  RotEnc::ButtonState buttonState = rotenc.getButtonState();
-  if (buttonState == RotEnc::BUTTON_SHORT_CLICK) {
-#ifdef DEBUG
-    Serial.println(F("Short click detected."));
-#endif
+  if (event.type == RotEncBase::EVENT_SHORT_CLICK) {
     lampOn = !lampOn;
-#ifdef DEBUG
-    if (lampOn)
-      Serial.println(F("Lamp on."));
-    else
-      Serial.println(F("Lamp off."));
+    TELEMETRY(HW_TELEMETRY_LEVEL_INFO, TELEMETRY_ID_LAMP, lampOn);
     updateNeopixels();
   }
+  if (!brightnessEncoder) {
+    static const uint8_t controlCycle = CONTROL_NUMBER - CONTROL_FIRST;
+    if ((event.type == RotEncBase::EVENT_LONG_CLICK) || (event.type == RotEncBase::EVENT_HOLD_REPEAT)) {
+      selectControlParameter((ControlParameter)(CONTROL_FIRST + (controlParameter - CONTROL_FIRST + 1) % controlCycle));
+    }
+    if (event.type == RotEncBase::EVENT_DOUBLE_CLICK) {
+      selectControlParameter((ControlParameter)(CONTROL_FIRST + (controlParameter - CONTROL_FIRST + controlCycle - 1) % controlCycle));
+    }
+  }
+  saveLampState();
+}
+
+void loop() {
+#ifdef HW_NETWORK
+  bool networkActive = network.isActive();
 #endif
-  if (buttonState == RotEnc::BUTTON_LONG_CLICK) {
-#ifdef DEBUG
-    Serial.println(F("Long click detected."));
+  RotEncBase::Event event;
+  while (rotenc.getEvent(event))
+    handleEvent(event, false);
+#ifdef HW_ROTENC_BRIGHTNESS
+  while (brightnessRotenc.getEvent(event))
+    handleEvent(event, true);
 #endif
-    controlParameter = !controlParameter;
-    updateControl();
-#ifdef DEBUG
-    if (controlParameter)
-      Serial.println(F("Rotary Encoder shaft now controls hue."));
-    else
-      Serial.println(F("Rotary Encoder shaft now controls brightness."));
+  storage.update();
+#ifdef HW_NETWORK
+  network.receive(neopixel);
+  //Frame buffer still contains the received frame, colour is set again by the transition
+  if (networkActive && !network.isActive()) updateNeopixels();
 #endif
-    updateNeopixels();
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+  //Requests from host
+  switch (telemetry.getRequest()) {
+#ifdef HW_PROFILER
+    case TELEMETRY_REQUEST_PROFILE:
+      profiler.dump();
+      break;
+#endif
+    default:
+      break;
   }
+#endif
+#ifdef HW_PROFILE_ESP8266
+  if (frameDue) {
+    frameDue = false;
+    renderFrame();
+    noInterrupts();
+    scheduler.frameComplete();
+    interrupts();
+  }
+#else
+  sleepUntilInterrupt();
+#endif
 }
@@ -0,0 +1,83 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "hardware.h"
+
+#ifdef HW_NETWORK
+
+#include "network.h"
+
+//////////////////////////////////////////////////////////////////////
+// Network
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises private fields with default values
+Network::Network() {
+  active = false;
+  timeout = 0;
+  packetTime = 0;
+  overridden = false;
+  overrideTime = 0;
+}
+
+/// @brief Connects to HW_NETWORK_SSID and starts listening on HW_NETWORK_PORT
+///
+/// Does not wait for the connection, WiFi connects in background and packets are
+/// received once it is established
+///
+void Network::begin(void) {
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(HW_NETWORK_SSID, HW_NETWORK_PASSWORD);
+  udp.begin(HW_NETWORK_PORT);
+}
+
+/// @brief Receives a pending packet, if any, and checks the timeouts
+///
+/// Call this method from the main loop; received neopixels are written to the frame
+/// buffer and sent by the next Neopixel::update()
+///
+/// @param neopixel Neopixels which receive the frame
+/// @return True if neopixel data were received
+///
+bool Network::receive(Neopixel & neopixel) {
+  uint32_t now = millis();
+  if (overridden && ((now - overrideTime) >= HW_NETWORK_OVERRIDE_TIME)) overridden = false;
+  if (active && (timeout != timeoutForever) && ((now - packetTime) >= (timeout * 1000UL))) active = false;
+  int size = udp.parsePacket();
+  if (size <= 0) return (false);
+  uint8_t header[headerSize];
+  if ((size < headerSize) || (udp.read(header, headerSize) != headerSize) ||
+      (header[0] != protocolId) || overridden) {
+    udp.flush();
+    return (false);
+  }
+  timeout = header[1];
+  packetTime = now;
+  active = (timeout != 0);
+  uint16_t first = ((uint16_t)header[2] << 8) | header[3];
+  uint16_t number = (size - headerSize) / bytesPerPixel;
+  if (!active || (first >= HW_NEOPIXEL_NUMBER) || !number) {
+    udp.flush();
+    return (false);
+  }
+  if (number > (HW_NEOPIXEL_NUMBER - first)) number = HW_NEOPIXEL_NUMBER - first;
+  udp.read(neopixel.writePixels(first, number), number * bytesPerPixel);
+  udp.flush();
+  return (true);
+}
+
+/// @brief Hands neopixels back to the lamp, call when the rotary encoder is used
+///
+/// Received packets are ignored for HW_NETWORK_OVERRIDE_TIME
+///
+void Network::override(void) {
+  active = false;
+  overridden = true;
+  overrideTime = millis();
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Neopixel frames received over WiFi
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <Arduino.h>
+
+#include "hardware.h"
+
+#ifdef HW_NETWORK
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "neopixel.h"
+
+/// @defgroup network Network
+/// @brief Receives neopixel frames over UDP and shows them instead of the lamp colour
+///
+/// Provides Network class which is only available if HW_NETWORK is defined (ESP8266 only)
+///
+/// This module also contains all macros used by Network class as a compile-time settings
+///
+/// @{
+
+/// @brief Receives neopixel data from UDP packets directly into the neopixel frame buffer
+///
+/// Packet format (all numbers are big-endian):
+/// * byte 0: protocol id, always 'G'
+/// * byte 1: timeout in seconds; lamp colour is shown again if no packet is received
+/// during the timeout; 0 hands neopixels back to the lamp immediately, 255 means no timeout
+/// * bytes 2..3: index of the first neopixel in the packet
+/// * bytes 4...: green, red and blue components of each neopixel, i.e. wire order of
+/// the frame buffer; neopixels beyond HW_NEOPIXEL_NUMBER are ignored
+///
+/// Packet payload is read straight into the frame buffer (see Neopixel::writePixels()),
+/// so no packet-sized buffer is allocated; global brightness set by the lamp still
+/// applies to the received neopixels
+///
+/// Rotary encoder takes precedence: after override() received packets are ignored for
+/// HW_NETWORK_OVERRIDE_TIME
+///
+class Network {
+  public:
+    Network();
+    void begin(void);
+    bool receive(Neopixel & neopixel);
+    inline bool isActive(void);
+    void override(void);
+  private:
+    static const uint8_t protocolId = 'G';        ///< Value of the packet's first byte
+    static const uint8_t headerSize = 4;          ///< Bytes in the packet before neopixel data
+    static const uint8_t bytesPerPixel = 3;       ///< Bytes per neopixel in the packet
+    static const uint8_t timeoutForever = 255;    ///< Timeout value which disables timeout
+  private:
+    WiFiUDP udp;                 ///< Socket which receives the packets
+    bool active;                 ///< True while received frame is shown instead of lamp colour
+    uint8_t timeout;             ///< Timeout of the latest packet in seconds
+    uint32_t packetTime;         ///< millis() value when the latest packet was received
+    bool overridden;             ///< True for HW_NETWORK_OVERRIDE_TIME after override()
+    uint32_t overrideTime;       ///< millis() value when override() was called
+};
+
+/// @}
+
+//////////////////////////////////////////////////////////////////////
+// Network inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Checks whether neopixels are controlled over the network
+/// @return True if received frame is shown and lamp frames must not be rendered
+bool Network::isActive(void) {
+  return (active);
+}
+
+#endif
+
+#endif // #ifndef NETWORK_H
@@ -0,0 +1,144 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "hardware.h"
+
+#ifdef HW_NEOPIXEL_PARALLEL
+
+#include "parallel.h"
+#include "profiler.h"
+
+//////////////////////////////////////////////////////////////////////
+// ParallelNeopixel
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises private fields with default values
+///
+/// All neopixels are marked as changed so that the first update always reaches the
+/// neopixels, regardless of what they displayed before reset
+ParallelNeopixel::ParallelNeopixel() {
+  memset(planes, 0, sizeof(planes));
+  changedPixels = pixelsPerStrip;
+  latchStartTime = 0;
+  outputScale = outputScaleMax;
+}
+
+/// @brief Set up neopixel chains for use
+void ParallelNeopixel::begin(void) {
+  //Set pins of all chains low and to output mode
+  HW_NEOPIXEL_PARALLEL_PORT &= ~stripMask;
+  HW_NEOPIXEL_PARALLEL_DIR |= stripMask;
+}
+
+/// @brief Set all neopixels of all chains to the same colour
+///
+/// Colour is the same for every chain, so each bit plane has either all chains' bits set
+/// or none of them; the neopixels are not updated until update() is called
+///
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+void ParallelNeopixel::setUniformColour(uint8_t r, uint8_t g, uint8_t b) {
+  PROFILE_SCOPE(PROFILE_SET_UNIFORM);
+  uint8_t pixel[planesPerPixel];
+  uint8_t components[bytesPerPixel] = {outputByte(g), outputByte(r), outputByte(b)};
+  uint8_t * plane = pixel;
+  for (uint8_t i = 0; i < bytesPerPixel; i++) {
+    uint8_t component = components[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      *plane++ = (component & 0x80) ? stripMask : 0;
+      component <<= 1;
+    }
+  }
+  for (uint8_t i = 0; i < pixelsPerStrip; i++) {
+    uint8_t * destination = &planes[i * planesPerPixel];
+    if (memcmp(destination, pixel, planesPerPixel)) {
+      memcpy(destination, pixel, planesPerPixel);
+      if (changedPixels <= i) changedPixels = i + 1;
+    }
+  }
+}
+
+/// @brief Sets colour of a single neopixel in one of the chains
+///
+/// Brightness set by setBrightness() is applied to the colour components which are then
+/// transposed into the bit planes; if the new colour is the same as the colour already in
+/// the frame buffer, the neopixel is not marked as changed
+///
+/// @param strip Chain, range 0..HW_NEOPIXEL_PARALLEL_STRIPS-1
+/// @param index Index of the neopixel in the chain, range 0..pixelsPerStrip-1
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+void ParallelNeopixel::setPixel(uint8_t strip, uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+  if ((strip >= HW_NEOPIXEL_PARALLEL_STRIPS) || (index >= pixelsPerStrip)) return;
+  uint8_t components[bytesPerPixel] = {outputByte(g), outputByte(r), outputByte(b)};
+  uint8_t stripBit = _BV(HW_NEOPIXEL_PARALLEL_FIRST_BIT + strip);
+  uint8_t * plane = &planes[index * planesPerPixel];
+  uint8_t changed = 0;
+  for (uint8_t i = 0; i < bytesPerPixel; i++) {
+    uint8_t component = components[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      uint8_t value = (component & 0x80) ? (*plane | stripBit) : (*plane & ~stripBit);
+      changed |= value ^ *plane;
+      *plane++ = value;
+      component <<= 1;
+    }
+  }
+  if (changed && (changedPixels <= index)) changedPixels = index + 1;
+}
+
+/// @brief Sets global brightness of the neopixels
+///
+/// Brightness is applied to the colours set after this call; if HW_NEOPIXEL_GAMMA is
+/// defined, the brightness is gamma-corrected as well as the colour components
+///
+/// @param brightness Brightness, range 0..255 (255 is full brightness)
+void ParallelNeopixel::setBrightness(uint8_t brightness) {
+#ifdef HW_NEOPIXEL_GAMMA
+  outputScale = pgm_read_byte(&gammaTable[brightness]) + 1;
+#else
+  outputScale = brightness + 1;
+#endif
+}
+
+/// @brief Sends the frame buffer to all chains and latches it
+///
+/// Does nothing if the frame buffer was not changed since the previous update, otherwise
+/// sends neopixels up to the last changed position in the chains
+///
+/// Interrupts are disabled while the neopixel data are sent; if HW_NEOPIXEL_INTERRUPT_WINDOW
+/// is defined, interrupts are disabled for a single position at a time and pending
+/// interrupts which are not masked by TransmitInterruptMask are serviced between positions
+///
+/// @warning This method must not be re-entered, e.g. it must not be called from the main
+/// loop if it is also called from the frame scheduler's interrupt
+void ParallelNeopixel::update(void) {
+  uint8_t pixels = changedPixels;
+  changedPixels = 0;
+  if (!pixels) return;
+  while ((micros() - latchStartTime) < latchMicros);
+  PROFILE_SCOPE(PROFILE_TRANSMIT);
+  uint8_t oldSREG = SREG;
+#ifdef HW_NEOPIXEL_INTERRUPT_WINDOW
+  TransmitInterruptMask interruptMask;
+  const uint8_t * data = planes;
+  for (uint8_t i = 0; i < pixels; i++) {
+    noInterrupts();
+    sendPlanes(data, planesPerPixel);
+    SREG = oldSREG; // Pending interrupts are serviced here
+    data += planesPerPixel;
+  }
+#else
+  noInterrupts();
+  sendPlanes(planes, pixels * planesPerPixel);
+  SREG = oldSREG;
+#endif
+  latchStartTime = micros();
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Several neopixel chains driven in parallel from one port
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <Arduino.h>
+
+#include "hardware.h"
+#include "neopixel.h"
+
+/// @defgroup parallel_neopixel Parallel neopixel chains
+/// @ingroup neopixel
+/// @brief Drives up to 8 neopixel chains connected to the bits of the same port
+///
+/// Provides ParallelNeopixel class which is used instead of Neopixel if
+/// HW_NEOPIXEL_PARALLEL is defined
+///
+/// @{
+
+/// @brief Used for the fast control of several neopixel chains at once
+///
+/// HW_NEOPIXEL_NUMBER neopixels are split into HW_NEOPIXEL_PARALLEL_STRIPS chains of equal
+/// length; neopixel index / pixelsPerStrip is the chain and index % pixelsPerStrip is the
+/// position in the chain. All chains are sent at the same time, so the frame takes as long
+/// as a single chain
+///
+/// The frame buffer is stored as bit planes: each byte holds the same bit of the same colour
+/// component for every chain, positioned as the chains' pins in the port. Bits are transposed
+/// when the neopixel is set, so that sending a bit to all chains is a single port write
+///
+/// Since colour components are transposed, global brightness (and gamma correction if
+/// HW_NEOPIXEL_GAMMA is defined) is applied by setPixel() rather than on output: after
+/// setBrightness() the frame must be set again
+///
+/// Frame buffer takes 24 bytes per position in the chain regardless of the number of chains,
+/// thus it only uses as much RAM as Neopixel when 8 chains are connected
+///
+class ParallelNeopixel {
+  public:
+    ParallelNeopixel();
+    void begin(void);
+    void setUniformColour(uint8_t r, uint8_t g, uint8_t b);
+    void setPixel(uint8_t strip, uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+  public:
+    inline void setPixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+    void setBrightness(uint8_t brightness);
+    void update(void);
+  public:
+    static const uint8_t pixelsPerStrip = HW_NEOPIXEL_NUMBER / HW_NEOPIXEL_PARALLEL_STRIPS; ///< Neopixels in each chain
+  private:
+    static const uint8_t bytesPerPixel = 3;               ///< Colour components per neopixel
+    static const uint8_t planesPerPixel = bytesPerPixel * 8;  ///< Bit planes per position in the chain
+    static const uint16_t frameSize = pixelsPerStrip * planesPerPixel;  ///< Frame buffer size in bytes
+    static const uint16_t outputScaleMax = 256;          ///< Output scale which leaves colour components unchanged
+    /// Pins of all chains in the port
+    static const uint8_t stripMask = ((1 << HW_NEOPIXEL_PARALLEL_STRIPS) - 1) << HW_NEOPIXEL_PARALLEL_FIRST_BIT;
+    /// Minimum time between frames in microseconds, gap is measured with micros() which has resolution of 64 CPU cycles
+    static const uint8_t latchMicros = (HW_NEOPIXEL_RES / 1000UL) + 1 + (64 / clockCyclesPerMicrosecond());
+  private:
+    uint8_t planes[frameSize + 1];   ///< Bit planes in wire order, one spare byte is read by sendPlanes() past the end
+    volatile uint8_t changedPixels;  ///< Number of leading positions in the chains which include all neopixels changed since the last update
+    uint32_t latchStartTime;         ///< micros() value at the end of the previous frame
+    uint16_t outputScale;            ///< Scale applied to the colour components, range 1..outputScaleMax
+  private:
+    inline uint8_t outputByte(uint8_t input);
+    inline void sendPlanes(const uint8_t * data, uint16_t size);
+};
+
+/// @}
+
+#ifdef HW_NEOPIXEL_PARALLEL
+
+#if HW_NEOPIXEL_PARALLEL_STRIPS < 1 || (HW_NEOPIXEL_PARALLEL_FIRST_BIT + HW_NEOPIXEL_PARALLEL_STRIPS) > 8
+#error "HW_NEOPIXEL_PARALLEL_STRIPS chains starting from HW_NEOPIXEL_PARALLEL_FIRST_BIT do not fit into the port"
+#endif
+
+#ifdef HW_PROFILE_ESP8266
+#error "HW_NEOPIXEL_PARALLEL is not available on ESP8266"
+#endif
+
+#ifdef HW_NEOPIXEL_STREAMING
+#error "HW_NEOPIXEL_PARALLEL requires frame buffer and cannot be used with HW_NEOPIXEL_STREAMING"
+#endif
+
+#ifdef HW_NEOPIXEL_DITHER
+#error "HW_NEOPIXEL_DITHER is not available with HW_NEOPIXEL_PARALLEL"
+#endif
+
+#if (HW_NEOPIXEL_NUMBER % HW_NEOPIXEL_PARALLEL_STRIPS) != 0
+#error "HW_NEOPIXEL_NUMBER must be divisible by HW_NEOPIXEL_PARALLEL_STRIPS"
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// ParallelNeopixel inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Cycles spent in the high part of the bit when 0 is sent, less the overhead of instructions
+#define PARALLEL_ZERO_CYCLES (NS_TO_CYCLES(HW_NEOPIXEL_T0H) - 1)
+/// @brief Additional cycles spent in the high part of the bit when 1 is sent, less the overhead of instructions
+#define PARALLEL_ONE_CYCLES (NS_TO_CYCLES(HW_NEOPIXEL_T1H) - NS_TO_CYCLES(HW_NEOPIXEL_T0H) - 4)
+/// @brief Cycles spent in the low part of the bit, less the overhead of instructions
+#define PARALLEL_LOW_CYCLES (NS_TO_CYCLES(HW_NEOPIXEL_TBIT) - NS_TO_CYCLES(HW_NEOPIXEL_T1H) - 5)
+
+#if (PARALLEL_ZERO_CYCLES < 0) || (PARALLEL_ONE_CYCLES < 0) || (PARALLEL_LOW_CYCLES < 0)
+#error "Neopixel timings in hardware.h are too short for parallel output at this F_CPU"
+#endif
+
+/// @brief Sends bit planes to all chains at once
+///
+/// Each bit plane is a single neopixel bit for every chain: all chains' pins are set high,
+/// then the plane is written to the port (chains sending 0 go low at T0H) and then all pins
+/// are set low at T1H. The next plane is loaded while the pins which send 1 are high, so
+/// every bit takes NS_TO_CYCLES(HW_NEOPIXEL_TBIT) cycles
+///
+/// Port bits other than the chains' pins are kept as they were when this method is called
+///
+/// @param data Pointer to the first plane to send, the byte after the last plane is read but not sent
+/// @param size Number of planes to send
+/// @warning The interrupts must be turned off while the planes are being sent
+void ParallelNeopixel::sendPlanes(const uint8_t * data, uint16_t size) {
+  if (!size) return;
+  uint8_t low = HW_NEOPIXEL_PARALLEL_PORT & ~stripMask;
+  uint8_t high = low | stripMask;
+  uint8_t plane;
+  asm volatile (
+    "ld   %[plane], %a[ptr]+ \n\t"      // Load the first plane
+    "or   %[plane], %[low] \n\t"
+    "1: \n\t"
+    "out  %[port], %[high] \n\t"        // All chains go high, every bit starts here
+    ".rept %[zeroCycles] \n\t"
+    "nop \n\t"
+    ".endr \n\t"
+    "out  %[port], %[plane] \n\t"       // Chains sending 0 go low here (T0H)
+    "ld   %[plane], %a[ptr]+ \n\t"      // Load the next plane while chains sending 1 are high
+    "or   %[plane], %[low] \n\t"
+    ".rept %[oneCycles] \n\t"
+    "nop \n\t"
+    ".endr \n\t"
+    "out  %[port], %[low] \n\t"         // All chains go low here (T1H)
+    ".rept %[lowCycles] \n\t"
+    "nop \n\t"
+    ".endr \n\t"
+    "sbiw %[count], 1 \n\t"
+    "brne 1b \n\t"
+    :
+    [plane] "=&r" (plane),
+    [ptr] "+e" (data),
+    [count] "+w" (size)
+    :
+    [port] "I" (_SFR_IO_ADDR(HW_NEOPIXEL_PARALLEL_PORT)),
+    [low] "r" (low),
+    [high] "r" (high),
+    [zeroCycles] "I" (PARALLEL_ZERO_CYCLES),
+    [oneCycles] "I" (PARALLEL_ONE_CYCLES),
+    [lowCycles] "I" (PARALLEL_LOW_CYCLES)
+    :
+    "memory"
+  );
+}
+
+/// @brief Applies gamma correction (if enabled) and global brightness to the colour component
+/// @param input Colour component at full brightness
+/// @return Colour component to be sent to the neopixels
+uint8_t ParallelNeopixel::outputByte(uint8_t input) {
+#ifdef HW_NEOPIXEL_GAMMA
+  input = pgm_read_byte(&gammaTable[input]);
+#endif
+  return (((uint16_t)input * outputScale) >> 8);
+}
+
+/// @brief Sets colour of a single neopixel in the frame buffer
+///
+/// Neopixel indexes are mapped to the chains in blocks of pixelsPerStrip, e.g. with
+/// HW_NEOPIXEL_LAYOUT_COLUMNS each column of the matrix may be a separate chain
+///
+/// @param index Index of the neopixel, range 0..HW_NEOPIXEL_NUMBER-1
+/// @param r Red component, range 0..255
+/// @param g Green component, range 0..255
+/// @param b Blue component, range 0..255
+void ParallelNeopixel::setPixel(uint8_t index, uint8_t r, uint8_t g, uint8_t b) {
+  setPixel(index / pixelsPerStrip, index % pixelsPerStrip, r, g, b);
+}
+
+#endif
+
+#endif // #ifndef PARALLEL_H
@@ -0,0 +1,88 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Port traits used as template parameters instead of register macros
+
+#ifndef PORTS_H
+#define PORTS_H
+
+#include <Arduino.h>
+
+#include "hardware.h"
+
+/// @defgroup ports Port traits
+/// @brief Classes which describe an I/O port and its Pin Change Interrupt
+///
+/// Each port is a class with static inline methods only, so it occupies no RAM and adds no
+/// indirection: when a class template (e.g. RotEnc) is instantiated with a port and
+/// constant bit numbers, every register access compiles to a single in / sbi / cbi
+/// instruction, exactly as with the register macros
+///
+/// Every port traits class provides the following methods:
+/// * read() returns the input levels of the port's pins
+/// * setInputPullup(bit) sets the pin to input mode with pull-up enabled
+/// * enablePinChange(bit) and disablePinChange(bit) control Pin Change Interrupt of the pin
+/// * enablePinChangeInterrupt() clears pending flag and enables Pin Change Interrupt vector
+/// of the port
+///
+/// On ATmega and ATtiny Pin Change Interrupt mask bits correspond to the bits of the port
+///
+/// @{
+
+#if defined(HW_PROFILE_ESP8266)
+
+/// @brief Eight consecutive GPIOs starting from firstGpio
+///
+/// Pin change interrupts are attached per pin by the sketch with attachInterrupt(), so the
+/// pin change methods do nothing
+///
+/// @tparam firstGpio GPIO which corresponds to bit 0 of the port
+template <uint8_t firstGpio>
+struct GpioPort {
+  static inline uint8_t read(void) { return ((uint8_t)(GPI >> firstGpio)); }
+  static inline uint8_t pin(uint8_t bit) { return (firstGpio + bit); }   ///< GPIO number of the bit
+  static inline void setInputPullup(uint8_t bit) { pinMode(firstGpio + bit, INPUT_PULLUP); }
+  static inline void enablePinChange(uint8_t) {}
+  static inline void disablePinChange(uint8_t) {}
+  static inline void enablePinChangeInterrupt(void) {}
+};
+
+#else
+
+/// @brief Defines port traits class of an AVR port
+/// @param name Name of the class
+/// @param in Input register
+/// @param dir Direction register
+/// @param out Output register
+/// @param mask Pin Change Interrupt mask register
+/// @param flagReg Register which contains Pin Change Interrupt flag
+/// @param flag Pin Change Interrupt flag bit
+/// @param enableReg Register which enables Pin Change Interrupt
+/// @param enable Pin Change Interrupt enable bit
+#define PORT_TRAITS(name, in, dir, out, mask, flagReg, flag, enableReg, enable) \
+  struct name { \
+    static inline uint8_t read(void) { return (in); } \
+    static inline void setInputPullup(uint8_t bit) { bitClear(dir, bit); bitSet(out, bit); } \
+    static inline void enablePinChange(uint8_t bit) { bitSet(mask, bit); } \
+    static inline void disablePinChange(uint8_t bit) { bitClear(mask, bit); } \
+    static inline void enablePinChangeInterrupt(void) { bitSet(flagReg, flag); bitSet(enableReg, enable); } \
+  }
+
+#if defined(HW_PROFILE_ATTINY85)
+PORT_TRAITS(PortB, PINB, DDRB, PORTB, PCMSK, GIFR, PCIF, GIMSK, PCIE);    ///< Port B, PCINT0_vect
+#else
+PORT_TRAITS(PortB, PINB, DDRB, PORTB, PCMSK0, PCIFR, PCIF0, PCICR, PCIE0);  ///< Port B, PCINT0_vect
+PORT_TRAITS(PortC, PINC, DDRC, PORTC, PCMSK1, PCIFR, PCIF1, PCICR, PCIE1);  ///< Port C, PCINT1_vect
+PORT_TRAITS(PortD, PIND, DDRD, PORTD, PCMSK2, PCIFR, PCIF2, PCICR, PCIE2);  ///< Port D, PCINT2_vect
+#endif
+
+#endif
+
+/// @}
+
+#endif // #ifndef PORTS_H
@@ -0,0 +1,88 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "profiler.h"
+#include "hardware.h"
+#include "telemetry.h"
+
+#ifdef HW_PROFILER
+
+//////////////////////////////////////////////////////////////////////
+// Profiler
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises statistics
+Profiler::Profiler() {
+  reset();
+  overhead = 0;
+}
+
+/// @brief Measures probe's own overhead, call after Timer1 is started
+void Profiler::begin(void) {
+  uint16_t startCycles = profileCycles();
+  uint16_t endCycles = profileCycles();
+  overhead = endCycles - startCycles;
+}
+
+/// @brief Adds a measurement to the probe's statistics
+///
+/// Can be called both from ISR and from the main loop
+///
+/// @param probe Probe, see ProfileProbe
+/// @param cycles Measured time, CPU cycles
+///
+void Profiler::record(uint8_t probe, uint16_t cycles) {
+  if (probe >= PROFILE_NUMBER) return;
+  cycles = (cycles > overhead) ? (cycles - overhead) : 0;
+  uint8_t oldSREG = SREG;
+  noInterrupts();
+  Entry & entry = entries[probe];
+  if (entry.count < 0xffff) {
+    if (cycles < entry.minCycles) entry.minCycles = cycles;
+    if (cycles > entry.maxCycles) entry.maxCycles = cycles;
+    entry.sumCycles += cycles;
+    entry.count++;
+  }
+  SREG = oldSREG;
+}
+
+/// @brief Sends statistics of all probes as telemetry records and starts collecting anew
+///
+/// For each probe TELEMETRY_ID_PROFILE_PROBE, TELEMETRY_ID_PROFILE_MIN,
+/// TELEMETRY_ID_PROFILE_MAX, TELEMETRY_ID_PROFILE_AVERAGE and TELEMETRY_ID_PROFILE_COUNT
+/// records are sent; call this method from the main loop only
+///
+void Profiler::dump(void) {
+  for (uint8_t i = 0; i < PROFILE_NUMBER; i++) {
+    uint8_t oldSREG = SREG;
+    noInterrupts();
+    Entry entry = entries[i];
+    SREG = oldSREG;
+    telemetry.send(TELEMETRY_ID_PROFILE_PROBE, i);
+    telemetry.send(TELEMETRY_ID_PROFILE_COUNT, entry.count);
+    if (!entry.count) continue;
+    telemetry.send(TELEMETRY_ID_PROFILE_MIN, entry.minCycles);
+    telemetry.send(TELEMETRY_ID_PROFILE_MAX, entry.maxCycles);
+    telemetry.send(TELEMETRY_ID_PROFILE_AVERAGE, entry.sumCycles / entry.count);
+  }
+  uint8_t oldSREG = SREG;
+  noInterrupts();
+  reset();
+  SREG = oldSREG;
+}
+
+/// @brief Clears statistics of all probes
+void Profiler::reset(void) {
+  for (uint8_t i = 0; i < PROFILE_NUMBER; i++) {
+    entries[i].minCycles = 0xffff;
+    entries[i].maxCycles = 0;
+    entries[i].sumCycles = 0;
+    entries[i].count = 0;
+  }
+}
+
+#endif
@@ -0,0 +1,139 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Cycle-accurate profiling of the hot paths
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+#include "hardware.h"
+
+/// @defgroup profiler Profiler
+/// @brief Measures execution time of the hot paths in CPU cycles
+///
+/// Provides Profiler class which collects minimum, maximum and average time per probe,
+/// and PROFILE_SCOPE() macro which measures time from its declaration until the end of the
+/// enclosing scope
+///
+/// Timer1 which runs freely at CPU clock (see Scheduler) is used as a cycle counter, thus
+/// scheduler must be started before probes give meaningful results and a single
+/// measurement must not exceed 65535 cycles. If an interrupt occurs inside the probe,
+/// the time spent in ISR is included in the measured time
+///
+/// If HW_PROFILER is not defined, probes are not compiled
+///
+/// @{
+
+/// Profiling probe
+enum ProfileProbe {
+  PROFILE_TRANSMIT,         ///< Neopixel::transmit()
+  PROFILE_SET_UNIFORM,      ///< Neopixel::setUniformColour()
+  PROFILE_ENCODER_ISR,      ///< Rotary encoder Pin Change ISR
+  PROFILE_CALC_RGB,         ///< calcRGB()
+  PROFILE_RENDER_FRAME,     ///< renderFrame()
+  PROFILE_NUMBER            ///< Number of probes
+};
+
+/// @brief Collects execution time statistics per probe
+///
+/// Statistics are sent as telemetry records by dump(), e.g. when requested from the host
+///
+class Profiler {
+  public:
+    Profiler();
+    void begin(void);
+    void record(uint8_t probe, uint16_t cycles);
+    void dump(void);
+  public:
+    /// Collected statistics of a probe
+    struct Entry {
+      uint16_t minCycles;     ///< Minimum time, CPU cycles
+      uint16_t maxCycles;     ///< Maximum time, CPU cycles
+      uint32_t sumCycles;     ///< Sum of all measured times, CPU cycles
+      uint16_t count;         ///< Number of measurements
+    };
+  private:
+    void reset(void);
+  private:
+    Entry entries[PROFILE_NUMBER];    ///< Statistics per probe, see ProfileProbe
+    uint16_t overhead;                ///< Cycles spent by the probe itself
+};
+
+/// @brief Measures time until the end of scope and records it on destruction
+class ProfileScope {
+  public:
+    inline ProfileScope(uint8_t probe);
+    inline ~ProfileScope();
+  private:
+    uint8_t probe;            ///< Probe to record the time to
+    uint16_t startCycles;     ///< Timer1 value at the beginning of the scope
+};
+
+/// @}
+
+#ifdef HW_PROFILER
+
+#if HW_TELEMETRY_LEVEL == HW_TELEMETRY_LEVEL_OFF
+#error "HW_PROFILER requires telemetry to send the results"
+#endif
+
+extern Profiler profiler;
+
+#define PROFILE_SCOPE_NAME(line) profileScope ## line                         ///< Unique name of a scope variable
+#define PROFILE_SCOPE_LINE(probe, line) ProfileScope PROFILE_SCOPE_NAME(line)(probe)  ///< Declares scope variable
+
+/// @brief Measures time from this point until the end of the enclosing scope
+/// @param probe Probe to record the time to, see ProfileProbe
+#define PROFILE_SCOPE(probe) PROFILE_SCOPE_LINE(probe, __LINE__)
+
+inline uint16_t profileCycles(void);
+
+//////////////////////////////////////////////////////////////////////
+// Profiler inline functions
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Reads Timer1 used as a cycle counter
+///
+/// 16-bit TCNT1 is read through the shared TEMP register, so an interrupt which reads
+/// or writes another 16-bit Timer1 register (e.g. OCR1A in the scheduler tick) between
+/// the two byte reads corrupts the value; interrupts are disabled for the read
+///
+/// @return Current Timer1 value
+uint16_t profileCycles(void) {
+  uint8_t oldSREG = SREG;
+  noInterrupts();
+  uint16_t cycles = TCNT1;
+  SREG = oldSREG;
+  return (cycles);
+}
+
+//////////////////////////////////////////////////////////////////////
+// ProfileScope inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Starts measurement
+/// @param probe Probe to record the time to, see ProfileProbe
+ProfileScope::ProfileScope(uint8_t probe) : probe(probe) {
+  startCycles = profileCycles();
+}
+
+/// @brief Stops measurement and records the time
+ProfileScope::~ProfileScope() {
+  uint16_t endCycles = profileCycles();
+  profiler.record(probe, endCycles - startCycles);
+}
+
+#else
+
+#define PROFILE_SCOPE(probe) do {} while (0)
+
+#endif
+
+#endif // #ifndef PROFILER_H
@@ -0,0 +1,46 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Quadrature decoding of rotary encoder lines
+
+#ifndef QUADRATURE_H
+#define QUADRATURE_H
+
+#include "hal.h"
+
+/// @addtogroup rot_enc_control
+/// @{
+
+inline int8_t quadratureStep(uint8_t & state, uint8_t lines);
+
+/// @}
+
+//////////////////////////////////////////////////////////////////////
+// Quadrature inline functions
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Decodes one change of rotary encoder lines
+///
+/// Lookup table approach described here:
+/// https://www.circuitsathome.com/mcu/reading-rotary-encoder-on-arduino/
+///
+/// This function does not depend on hardware and can be compiled for the host
+///
+/// @param state Previous and current line states, keep between calls, initially 0
+/// @param lines Current state of the lines: bit 0 is line A and bit 1 is line B
+/// @return Increment -1, 0 (invalid or no transition) or 1
+int8_t quadratureStep(uint8_t & state, uint8_t lines) {
+  static const HAL_ISR_PROGMEM int8_t statesTable[] = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
+  static const uint8_t fourLowestBits = 0x0f;
+  state <<= 2;
+  state |= lines;
+  state &= fourLowestBits;
+  return (pgm_read_byte(&statesTable[state]));
+}
+
+#endif // #ifndef QUADRATURE_H
@@ -0,0 +1,98 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Lock-free ring buffer to pass data between ISR and main loop
+
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include "hal.h"
+
+/// @defgroup ringbuf Ring Buffer
+/// @brief Single-producer / single-consumer queue
+///
+/// Provides RingBuffer class template which allows passing data from an interrupt
+/// handler to the main loop (or vice versa) without disabling interrupts
+///
+/// @{
+
+/// @brief Fixed-size single-producer / single-consumer queue
+///
+/// Only producer modifies head and only consumer modifies tail; both indexes are single
+/// bytes so they are read and written atomically. The element is fully written before
+/// head is advanced and fully read before tail is advanced, thus no interrupts need to
+/// be disabled as long as there is only one producer context and only one consumer
+/// context
+///
+/// One slot is always kept free to distinguish full buffer from empty one
+///
+/// @tparam T Element type
+/// @tparam size Number of slots, must be a power of 2 not exceeding 128
+template <typename T, uint8_t size>
+class RingBuffer {
+  public:
+    RingBuffer() : head(0), tail(0) {}
+    inline bool push(const T & element);
+    inline bool pop(T & element);
+    inline bool isEmpty(void);
+    inline void clear(void);
+  private:
+    static const uint8_t indexMask = size - 1;  ///< Wraps index around the buffer
+    T buffer[size];                             ///< Queued elements
+    volatile uint8_t head;                      ///< Next slot to write, modified by producer only
+    volatile uint8_t tail;                      ///< Next slot to read, modified by consumer only
+};
+
+/// @}
+
+//////////////////////////////////////////////////////////////////////
+// RingBuffer inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Adds element to the queue, call from producer context only
+/// @param element Element to add
+/// @return True if element was queued, false if the queue is full and element was dropped
+template <typename T, uint8_t size>
+bool RingBuffer<T, size>::push(const T & element) {
+  static_assert(size && !(size & (size - 1)) && size <= 128, "RingBuffer size must be a power of 2 not exceeding 128");
+  uint8_t currentHead = head;
+  uint8_t nextHead = (currentHead + 1) & indexMask;
+  if (nextHead == tail) return (false);
+  buffer[currentHead] = element;
+  asm volatile ("" ::: "memory"); // element must be written before it is published
+  head = nextHead;
+  return (true);
+}
+
+/// @brief Removes the oldest element from the queue, call from consumer context only
+/// @param element Receives removed element
+/// @return True if element was removed, false if the queue is empty
+template <typename T, uint8_t size>
+bool RingBuffer<T, size>::pop(T & element) {
+  uint8_t currentTail = tail;
+  if (currentTail == head) return (false);
+  element = buffer[currentTail];
+  asm volatile ("" ::: "memory"); // element must be read before the slot is released
+  tail = (currentTail + 1) & indexMask;
+  return (true);
+}
+
+/// @brief Checks whether there are any elements in the queue
+/// @return True if the queue is empty
+template <typename T, uint8_t size>
+bool RingBuffer<T, size>::isEmpty(void) {
+  return (head == tail);
+}
+
+/// @brief Discards all queued elements, call from consumer context only
+template <typename T, uint8_t size>
+void RingBuffer<T, size>::clear(void) {
+  tail = head;
+}
+
+#endif // #ifndef RINGBUF_H
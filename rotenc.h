@@ -11,102 +11,426 @@
 #ifndef ROTENC_H
 #define ROTENC_H
 
-#include <Arduino.h>
+#include "hal.h"
 
 #include "hardware.h"
+#ifdef ARDUINO
+#include "ports.h"
+#endif
+#include "ringbuf.h"
+#include "quadrature.h"
 
 /// @defgroup rot_enc_control Rotary Encoder Control
 /// @brief Allows using rotary encoder as a user interface controller
 ///
-/// Provides RotEnc class to use rotary encoder as a user interface controller (by turning
-/// encoder's shaft and short clicking / long clicking encoder button
+/// Provides RotEnc class template to use rotary encoders as user interface controllers (by
+/// turning encoder's shaft and short clicking / long clicking encoder button); encoder pins
+/// are template parameters, so several encoders may be used at once
+///
+/// Provides RotEncSampler class template which queues port snapshots taken by the Pin
+/// Change ISR, so that the ISR is short enough to be serviced between two neopixels (see
+/// HW_NEOPIXEL_INTERRUPT_WINDOW)
 ///
 /// This module also contains all macros used by RotEnc class as a compile-time settings
 ///
 /// @{
 
+/// @brief Types and constants which do not depend on rotary encoder pins
+///
+/// Events have the same type for every RotEnc instantiation, so a single event handler may
+/// serve all encoders
+///
+class RotEncBase {
+  public:
+    /// Type of the rotary encoder event
+    enum EventType {
+      EVENT_COUNTER,          ///< Counter reached new value.
+      EVENT_SHORT_CLICK,      ///< Short click on the button.
+      EVENT_LONG_CLICK,       ///< Button is held for HW_BUTTON_LONG_CLICK_MIN_TIME.
+      EVENT_DOUBLE_CLICK,     ///< Second click on the button within HW_BUTTON_DOUBLE_CLICK_TIME.
+      EVENT_HOLD_REPEAT,      ///< Button is still held, repeated every HW_BUTTON_HOLD_REPEAT_TIME after long click.
+    };
+    /// Rotary encoder event
+    struct Event {
+      EventType type;         ///< Event type
+      int16_t counter;        ///< New counter value if type is EVENT_COUNTER
+    };
+  protected:
+    /// Phase of button click detection
+    enum ButtonPhase {
+      BUTTON_IDLE,            ///< Button is released.
+      BUTTON_PRESSED,         ///< Button is pressed, waiting for release or long click.
+      BUTTON_HELD,            ///< Long click detected, button is still held.
+      BUTTON_CLICKED,         ///< Button released after a click, waiting for a second click.
+      BUTTON_DOUBLE_PRESSED,  ///< Double click detected, button is still held.
+    };
+    static const uint8_t debounceTicks = HW_BUTTON_DEBOUNCE_TIME * HW_SCHEDULER_TICK_RATE / 1000UL;            ///< Ticks to debounce button
+    static const uint16_t shortClickTicks = HW_BUTTON_SHORT_CLICK_MIN_TIME * HW_SCHEDULER_TICK_RATE / 1000UL;  ///< Ticks for short click
+    static const uint16_t longClickTicks = HW_BUTTON_LONG_CLICK_MIN_TIME * HW_SCHEDULER_TICK_RATE / 1000UL;    ///< Ticks for long click
+    static const uint16_t doubleClickTicks = HW_BUTTON_DOUBLE_CLICK_TIME * HW_SCHEDULER_TICK_RATE / 1000UL;    ///< Ticks to wait for second click
+    static const uint16_t holdRepeatTicks = HW_BUTTON_HOLD_REPEAT_TIME * HW_SCHEDULER_TICK_RATE / 1000UL;      ///< Ticks between hold-repeats
+  protected:
+    static const int16_t INT16_T_MIN = -32768;
+    static const int16_t INT16_T_MAX = 32767;
+  protected:
+    /// Event as stored in the queue
+    struct QueuedEvent {
+      uint8_t type;           ///< Event type, see EventType
+      uint8_t epoch;          ///< Value of counterEpoch when event was queued
+      int16_t counter;        ///< New counter value if type is EVENT_COUNTER
+    };
+    static const uint8_t eventQueueSize = 16;           ///< Maximum number of events waiting for the main loop
+#ifdef HW_ROTENC_ACCELERATION
+    static const uint16_t accelFastTicks = HW_ROTENC_ACCEL_FAST_TIME * HW_SCHEDULER_TICK_RATE / 1000000UL;  ///< Ticks between detents for fast rotation
+    static const uint16_t accelSlowTicks = HW_ROTENC_ACCEL_SLOW_TIME * HW_SCHEDULER_TICK_RATE / 1000000UL;  ///< Ticks between detents for moderate rotation
+#endif
+};
+
+/// @brief Queues snapshots of the port taken by the Pin Change ISR
+///
+/// Pin Change ISR only reads the port and queues the snapshot; the snapshots are decoded
+/// by RotEnc::lineHandler() called from the periodic tick ISR, so quadrature decoding,
+/// counter limits and acceleration do not run in the Pin Change ISR
+///
+/// A snapshot is queued for every interrupt, so line changes which follow each other
+/// while the tick is masked (e.g. while the frame is sent, see TransmitInterruptMask) are
+/// decoded one by one after the tick is unmasked instead of being coalesced
+///
+/// All encoders which share the Pin Change Interrupt vector share the port, so a single
+/// sampler serves all of them and the ISR reads the port once:
+/// @code
+/// RotEncSampler<PortD> rotencSampler;
+/// RotEnc<PortD, 2, 3, 4, 4> rotenc;
+///
+/// ISR (PCINT2_vect) {
+///  rotencSampler.interruptHandler();
+///}
+/// ISR (HW_SCHEDULER_INTVECT) {
+///  uint8_t port;
+///  while (rotencSampler.getSample(port)) rotenc.lineHandler(port);
+///  rotenc.tickInterruptHandler();
+///  ...
+///}
+/// @endcode
+///
+/// @tparam Port Port traits class of the encoder pins, see ports.h
+template <class Port>
+class RotEncSampler {
+  public:
+    inline void interruptHandler(void);
+    inline bool getSample(uint8_t & port);
+  private:
+    static const uint8_t sampleQueueSize = 16;  ///< Line changes which may occur between two ticks
+    RingBuffer<uint8_t, sampleQueueSize> samples; ///< Port snapshots queued by interruptHandler()
+};
+
 /// @brief Provides a way to control various user interfaces with a rotary encoder
 ///
 /// 16-bit signed counter is incremented/decremented within specified range by rotating
 /// encoder's shaft
 ///
-/// When encoder button is clicked, short and long clicks are detected
+/// If HW_ROTENC_ACCELERATION is defined and acceleration is enabled by setCounter(), the
+/// counter step is multiplied when detents follow each other quickly in the same
+/// direction (see HW_ROTENC_ACCEL_* in hardware.h)
+///
+/// Encoder button is sampled and debounced by a periodic timer tick; short clicks,
+/// double clicks, long clicks (as soon as the button is held long enough) and
+/// hold-repeats are detected
+///
+/// Counter changes and button clicks are queued as events by the interrupt handlers and
+/// retrieved in the main loop with getEvent(), so that no input is lost if the main loop
+/// is slow; interrupts are not disabled to retrieve an event
 ///
 /// Implementation based on lookup table approach described here:
 /// https://www.circuitsathome.com/mcu/reading-rotary-encoder-on-arduino/
 ///
-/// Interrupt handlers must be called externally from the corresponding ISR, e.g.:
-/// @code
-/// ISR (HW_ROTENC_INTVECT) {
-///  rotenc.encoderInterruptHandler();
-///  rotenc.buttonInterruptHandler();
-///}
-/// @endcode
+/// Port snapshots are taken by RotEncSampler in the Pin Change ISR (see its description
+/// for an example); lineHandler() must be called for every queued snapshot and
+/// tickInterruptHandler() must be called HW_SCHEDULER_TICK_RATE times per second, both
+/// from the frame scheduler's ISR
 ///
-/// @warning The following limitations apply:
-/// * All controller pins connected to rotary encoser must share the same port and the same
-/// Pin Change interrupt vector
-/// * This implementation uses macros to setup ports, pins, registers, etc (see hardware.h)
-/// in order to economise on RAM thus there is only one rotary encoder allowed per device
-
-class RotEnc {
+/// The pin change interrupt is only enabled for encoder lines A and B, lineHandler()
+/// compares the snapshot with the previous one; button does not generate pin change
+/// interrupts, so its contact bounce costs no extra interrupts
+///
+/// Both handlers run in the tick ISR with interrupts disabled, so they act as a single
+/// producer for the event queue
+///
+/// Port and pins are template parameters rather than macros, so register accesses are
+/// still constant-folded into single instructions (see ports.h); all state is kept in
+/// the instance and encoders which share the Pin Change Interrupt vector are served by
+/// calling lineHandler() of each of them with the snapshots of the shared sampler
+///
+/// @warning All pins of an encoder must share the same port
+///
+/// @tparam Port Port traits class of the encoder pins, see ports.h
+/// @tparam bitA Line A bit in the port
+/// @tparam bitB Line B bit in the port
+/// @tparam bitBtn Button bit in the port
+/// @tparam cyclesPerDetent Full pulse cycles per detent (click), 1 if encoder has no detents
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+class RotEnc : public RotEncBase {
+  static_assert(cyclesPerDetent > 0, "Rotary encoder must have at least one pulse cycle per detent");
   public:
     RotEnc();
-    void begin(void);
+    inline void begin(void);
   public:
     inline int16_t getCounter(void);
-    bool setCounter (int16_t counter, int16_t minLimit, int16_t maxLimit, bool wrap);
+    inline bool setCounter (int16_t counter, int16_t minLimit, int16_t maxLimit, bool wrap, bool accelerate);
   public:
-    /// State of the rotary encoder's button
-    enum ButtonState {
-      BUTTON_NONE,            ///< Button not pressed.
-      BUTTON_SHORT_CLICK,     ///< Short click on the button.
-      BUTTON_LONG_CLICK,      ///< Long click on the button.
-    };
-    inline ButtonState getButtonState(void);
+    inline bool getEvent(Event & event);
+    inline bool isEventQueued(void);
+    inline void setButtonWakeup(bool enable);
+    inline bool isButtonActive(void);
   public:
-    inline void encoderInterruptHandler(void);
-    inline void buttonInterruptHandler(void);
+    inline void lineHandler(uint8_t port);
+    inline void tickInterruptHandler(void);
   private:
-    static const int16_t INT16_T_MIN = -32768;
-    static const int16_t INT16_T_MAX = 32767;
-    static const int16_t minLimitRange = (INT16_T_MIN / HW_ROTENC_CYCLES_PER_DETENT /*+ 2*/ + 1);
-    static const int16_t maxLimitRange = INT16_T_MAX / HW_ROTENC_CYCLES_PER_DETENT /*- 2*/ - 1;
+    inline void encoderStep(uint8_t port);
+  private:
+    static const uint8_t encoderPinsMask = _BV(bitA) | _BV(bitB); ///< Lines A and B in the port
+    uint8_t oldPort;          ///< Port snapshot passed to the previous lineHandler() call
+    uint8_t quadratureState;  ///< Previous and current line states, see quadratureStep()
+  private:
+    inline void queueButtonEvent(EventType type);
+    uint8_t buttonPhase;      ///< Phase of click detection, see ButtonPhase
+    bool buttonPressed;       ///< Debounced button state
+    uint8_t buttonDebounce;   ///< Ticks the raw button state differs from the debounced one
+    uint16_t buttonTimer;     ///< Ticks since the last button phase change
+    uint16_t wakeupTicks;     ///< Ticks left until the press which woke the MCU up is surely detected, see setButtonWakeup()
+  private:
+    static const int16_t minLimitRange = (INT16_T_MIN / cyclesPerDetent /*+ 2*/ + 1);
+    static const int16_t maxLimitRange = INT16_T_MAX / cyclesPerDetent /*- 2*/ - 1;
   private:
     volatile int16_t counter;
     int16_t counterMinLimit;
     int16_t counterMaxLimit;
     bool counterWrap;
   private:
-    ButtonState buttonState;
+    inline void queueCounterEvent(void);
+#ifdef HW_ROTENC_ACCELERATION
+  private:
+    inline int8_t accelerationMultiplier(int8_t increment);
+  private:
+    bool counterAccelerate;       ///< True if acceleration is enabled for the current counter range
+    int8_t lastDetentDirection;   ///< Increment which reached the previous detent
+    uint16_t detentTicks;         ///< Ticks since the previous detent, saturates at 65535
+#endif
+  private:
+    RingBuffer<QueuedEvent, eventQueueSize> events;   ///< Events queued by the tick handlers
+    int16_t queuedCounter;    ///< Counter value reported by the last queued event, in detents
+    uint8_t counterEpoch;     ///< Incremented by setCounter() so that events queued before are discarded
 };
 
 /// @}
 
+#if ((HW_BUTTON_LONG_CLICK_MIN_TIME * HW_SCHEDULER_TICK_RATE / 1000UL) > 65535) || \
+    ((HW_BUTTON_DOUBLE_CLICK_TIME * HW_SCHEDULER_TICK_RATE / 1000UL) > 65535) || \
+    ((HW_BUTTON_HOLD_REPEAT_TIME * HW_SCHEDULER_TICK_RATE / 1000UL) > 65535)
+#error "Rotary encoder button timings are too long for HW_SCHEDULER_TICK_RATE"
+#endif
+
+#if (HW_BUTTON_DEBOUNCE_TIME * HW_SCHEDULER_TICK_RATE / 1000UL) > 255
+#error "HW_BUTTON_DEBOUNCE_TIME is too long for HW_SCHEDULER_TICK_RATE"
+#endif
+
+#ifdef HW_ROTENC_ACCELERATION
+#if (HW_ROTENC_ACCEL_FAST_TIME > 65535) || (HW_ROTENC_ACCEL_SLOW_TIME > 65535)
+#error "HW_ROTENC_ACCEL_FAST_TIME and HW_ROTENC_ACCEL_SLOW_TIME must not exceed 65535 microseconds"
+#endif
+#if (HW_ROTENC_ACCEL_FAST_TIME * HW_SCHEDULER_TICK_RATE / 1000000UL) < 2
+#error "HW_ROTENC_ACCEL_FAST_TIME is too short for HW_SCHEDULER_TICK_RATE"
+#endif
+#if HW_ROTENC_ACCEL_FAST_TIME > HW_ROTENC_ACCEL_SLOW_TIME
+#error "HW_ROTENC_ACCEL_FAST_TIME must not exceed HW_ROTENC_ACCEL_SLOW_TIME"
+#endif
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// RotEncSampler inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Call this method from the Pin Change ISR
+///
+/// Queues the port snapshot; if the queue is full, the snapshot is dropped
+///
+/// This is the whole Pin Change ISR: port read and ring buffer push are about 20 CPU
+/// cycles, about 70 cycles including interrupt response, register saving and return,
+/// which fits into the gap between two neopixels (see HW_NEOPIXEL_INTERRUPT_WINDOW)
+template <class Port>
+void RotEncSampler<Port>::interruptHandler(void) {
+  samples.push(Port::read());
+}
+
+/// @brief Retrieves the oldest port snapshot, call from the tick ISR only
+/// @param port Receives the port snapshot
+/// @return True if snapshot was retrieved or false if no snapshots are queued
+template <class Port>
+bool RotEncSampler<Port>::getSample(uint8_t & port) {
+  return (samples.pop(port));
+}
+
 //////////////////////////////////////////////////////////////////////
 // RotEnc inline methods
 //////////////////////////////////////////////////////////////////////
 
+/// @brief Initialises private fields with default values
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::RotEnc() {
+  counter = 0;
+  counterMinLimit = minLimitRange;
+  counterMaxLimit = maxLimitRange;
+  counterWrap = false;
+  oldPort = encoderPinsMask;
+  quadratureState = 0;
+  buttonPhase = BUTTON_IDLE;
+  buttonPressed = false;
+  buttonDebounce = 0;
+  buttonTimer = 0;
+  wakeupTicks = 0;
+#ifdef HW_ROTENC_ACCELERATION
+  counterAccelerate = false;
+  lastDetentDirection = 0;
+  detentTicks = 0xffff;
+#endif
+  queuedCounter = 0;
+  counterEpoch = 0;
+}
+
+/// @brief Sets up rotary encoder class before use
+///
+/// Sets pins corresponding to encoder lines A & B, and encoder switch
+/// to input mode and enables pull-up on these pins; current line levels are the
+/// starting point of quadrature decoding
+///
+/// Sets bits in Pin Change Interrupt registers corresponding to
+/// encoder lines A & B in order to activate their Pin Change Interrupts; button
+/// is sampled by tickInterruptHandler() instead
+///
+/// On ESP8266 pin change interrupts of lines A & B are attached by the sketch
+///
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+void RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::begin(void) {
+  //Set pins corresponding to lines A, B and button to input mode and enable pullup
+  Port::setInputPullup(bitA);
+  Port::setInputPullup(bitB);
+  Port::setInputPullup(bitBtn);
+  //Setup pin change interrupt registers
+  HalAtomicState oldSREG = halAtomicBegin();
+  oldPort = Port::read();
+  quadratureState = (bitRead(oldPort, bitB) << 1) | bitRead(oldPort, bitA);
+  Port::enablePinChange(bitA);
+  Port::enablePinChange(bitB);
+  Port::enablePinChangeInterrupt();
+  halAtomicEnd(oldSREG);
+}
+
+/// @brief Set rotary encoder's counter value and range
+///
+/// @param counterValue Counter value to set
+/// @param minLimit Minimum limit for counter range
+/// @param maxLimit Maximum limit for counter range
+/// @param wrap If true, the counter will "wrap around", e.i. if incremented beyond max limit
+/// (decremented beyond min limit) it will jump to opposite limit; if false, the counter
+/// incremented beyond max limit (decremented beyond min limin) will stay at the same limit
+/// @param accelerate If true, counter step increases when the shaft is rotated fast;
+/// ignored unless HW_ROTENC_ACCELERATION is defined
+/// @return True if parameters were set successfully or false if there was an error and
+/// parameters were not set
+///
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+bool RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::setCounter (int16_t counterValue, int16_t minLimit, int16_t maxLimit, bool wrap, bool accelerate) {
+  if (minLimit >= maxLimit) return (false);
+  if (minLimit < minLimitRange) minLimit = minLimitRange;
+  if (maxLimit > maxLimitRange) maxLimit = maxLimitRange;
+  if (counterValue > maxLimit) counterValue = maxLimit;
+  if (counterValue < minLimit) counterValue = minLimit;
+  HalAtomicState oldSREG = halAtomicBegin();
+  counter = counterValue * cyclesPerDetent;
+  counterMinLimit = minLimit * cyclesPerDetent;
+  counterMaxLimit = maxLimit * cyclesPerDetent;
+  counterWrap = wrap;
+  queuedCounter = counterValue;
+  counterEpoch++;
+#ifdef HW_ROTENC_ACCELERATION
+  counterAccelerate = accelerate;
+  lastDetentDirection = 0;
+#else
+  (void)accelerate;
+#endif
+  halAtomicEnd(oldSREG);
+  return (true);
+}
+
+/// @brief Enables or disables pin change interrupt on the encoder button
+///
+/// Button is normally sampled by tickInterruptHandler() and does not generate pin change
+/// interrupts; enable the interrupt before entering a sleep mode where the tick timer
+/// is stopped, so that pressing the button wakes the MCU up; the press is then detected
+/// by tickInterruptHandler() as usual
+///
+/// Disabling the interrupt after wakeup keeps isButtonActive() true for debounce time plus
+/// long click time, so that the tick timer keeps running until the press which woke the
+/// MCU up is debounced
+///
+/// @param enable True to enable button pin change interrupt, false to disable it
+///
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+void RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::setButtonWakeup(bool enable) {
+  HalAtomicState oldSREG = halAtomicBegin();
+  if (enable) {
+    Port::enablePinChange(bitBtn);
+  }
+  else {
+    Port::disablePinChange(bitBtn);
+    wakeupTicks = debounceTicks + longClickTicks;
+  }
+  halAtomicEnd(oldSREG);
+}
+
+/// @brief Checks whether the button needs the tick timer to detect a click
+///
+/// Call this method before entering a sleep mode where the tick timer is stopped: the
+/// button is only debounced and its clicks are only detected by tickInterruptHandler()
+///
+/// @return True if the button is pressed, bouncing, a click is being detected or the
+/// MCU was woken up recently (see setButtonWakeup())
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+bool RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::isButtonActive(void) {
+  HalAtomicState oldSREG = halAtomicBegin();
+  bool active = wakeupTicks || buttonDebounce || buttonPressed || (buttonPhase != BUTTON_IDLE);
+  halAtomicEnd(oldSREG);
+  return (active);
+}
+
 /// @brief Get rotary encoder's counter value
 /// @return Rotary encoder's counter value within range set by setcounter()
-int16_t RotEnc::getCounter(void) {
-  noInterrupts();
-  int16_t retVal = counter / HW_ROTENC_CYCLES_PER_DETENT;
-  interrupts();
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+int16_t RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::getCounter(void) {
+  HalAtomicState oldSREG = halAtomicBegin();
+  int16_t retVal = counter / cyclesPerDetent;
+  halAtomicEnd(oldSREG);
   return (retVal);
 }
 
-/// @brief Call this method from the corresponding ISR
+/// @brief Call this method from the tick ISR for every snapshot queued by RotEncSampler
+///
+/// Runs quadrature decoding only if encoder lines changed since the previous snapshot
 ///
-/// Updates counter when encoder shaft is rotated
-void RotEnc::encoderInterruptHandler(void) {
-  static const PROGMEM int8_t statesTable[] = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
-  static const uint8_t fourLowestBits = 0x0f;
-  static uint8_t oldState = 0;
-  oldState <<= 2;
-  oldState |= (bitRead(HW_ROTENC_PORT, HW_ROTENC_B_BIT) << 1) | bitRead(HW_ROTENC_PORT, HW_ROTENC_A_BIT);
-  oldState &= fourLowestBits;
-  int8_t increment = pgm_read_byte(&statesTable[oldState]);
+/// @param port Port snapshot retrieved with RotEncSampler::getSample()
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+void RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::lineHandler(uint8_t port) {
+  uint8_t changedPins = port ^ oldPort;
+  oldPort = port;
+  if (changedPins & encoderPinsMask) encoderStep(port);
+}
+
+/// @brief Updates counter when encoder shaft is rotated
+/// @param port Port snapshot passed to lineHandler()
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+void RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::encoderStep(uint8_t port) {
+  int8_t increment = quadratureStep(quadratureState, (bitRead(port, bitB) << 1) | bitRead(port, bitA));
+  if (!increment) return;
   if ((counter == counterMaxLimit) && (increment > 0)) {
     if (counterWrap)
       counter = counterMinLimit;
@@ -122,39 +446,167 @@ void RotEnc::encoderInterruptHandler(void) {
     increment = 0;
   }
   counter += increment;
+  if (counter % cyclesPerDetent) return;
+#ifdef HW_ROTENC_ACCELERATION
+  int8_t multiplier = increment ? accelerationMultiplier(increment) : 1;
+  if (multiplier > 1) {
+    int32_t accelerated = (int32_t)counter + (int16_t)increment * (multiplier - 1) * cyclesPerDetent;
+    if (accelerated > counterMaxLimit) accelerated = counterWrap ? counterMinLimit : counterMaxLimit;
+    if (accelerated < counterMinLimit) accelerated = counterWrap ? counterMaxLimit : counterMinLimit;
+    counter = accelerated;
+  }
+#endif
+  queueCounterEvent();
+}
+
+/// @brief Called from the tick ISR when the counter reaches a detent
+///
+/// Queues EVENT_COUNTER if counter value differs from the previously queued one; if the
+/// queue is full, the event is dropped and will be queued on the next detent
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+void RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::queueCounterEvent(void) {
+  int16_t detentCounter = counter / cyclesPerDetent;
+  if (detentCounter == queuedCounter) return;
+  QueuedEvent event = {EVENT_COUNTER, counterEpoch, detentCounter};
+  if (events.push(event)) queuedCounter = detentCounter;
 }
 
-/// @brief Call this method from the corresponding ISR
+#ifdef HW_ROTENC_ACCELERATION
+/// @brief Called from the tick ISR when the counter reaches a detent
+///
+/// Compares ticks since the previous detent with the acceleration thresholds; only
+/// detents reached in the same direction are accelerated, so that contact bounce
+/// around the detent does not cause the counter to jump
 ///
-/// Detect encoder button long and short clicks
-void RotEnc::buttonInterruptHandler(void) {
-  uint8_t currentButtonState = bitRead(HW_ROTENC_PORT, HW_ROTENC_BTN_BIT);
-  static bool oldButtonState = true;
-  static uint32_t buttonPressTime = 0;
-  if (!currentButtonState && oldButtonState) { // button pressed
-    buttonPressTime = millis();
+/// Ticks are counted by tickInterruptHandler(), so the interval is measured with tick
+/// resolution; snapshots queued while the tick was masked are decoded by the same tick,
+/// which only makes such detents look faster
+///
+/// @param increment Increment which reached the detent, -1 or 1
+/// @return Counter step multiplier
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+int8_t RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::accelerationMultiplier(int8_t increment) {
+  static const HAL_ISR_PROGMEM uint16_t accelTicks[] = {accelFastTicks, accelSlowTicks};
+  static const HAL_ISR_PROGMEM int8_t accelMultipliers[] = {HW_ROTENC_ACCEL_FAST_MULT, HW_ROTENC_ACCEL_SLOW_MULT};
+  uint16_t detentInterval = detentTicks;
+  detentTicks = 0;
+  bool sameDirection = (increment == lastDetentDirection);
+  lastDetentDirection = increment;
+  if (!counterAccelerate || !sameDirection) return (1);
+  for (uint8_t i = 0; i < sizeof(accelTicks) / sizeof(accelTicks[0]); i++) {
+    if (detentInterval < pgm_read_word(&accelTicks[i]))
+      return (pgm_read_byte(&accelMultipliers[i]));
+  }
+  return (1);
+}
+#endif
+
+/// @brief Call this method from the periodic tick ISR, HW_SCHEDULER_TICK_RATE times per second
+///
+/// Debounces encoder button, detects clicks and counts ticks between detents for
+/// acceleration; call lineHandler() for the queued snapshots first
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+void RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::tickInterruptHandler(void) {
+#ifdef HW_ROTENC_ACCELERATION
+  if (detentTicks < 0xffff) detentTicks++;
+#endif
+  bool pressed = !bitRead(Port::read(), bitBtn);
+  if (pressed == buttonPressed) {
+    buttonDebounce = 0;
+  }
+  else {
+    if (++buttonDebounce >= debounceTicks) {
+      buttonPressed = pressed;
+      buttonDebounce = 0;
+    }
   }
-  if (currentButtonState && !oldButtonState) { // button released
-    uint32_t buttonHoldTime = millis() - buttonPressTime;
-    if (buttonHoldTime > HW_BUTTON_SHORT_CLICK_MIN_TIME) buttonState = BUTTON_SHORT_CLICK;
-    if (buttonHoldTime > HW_BUTTON_LONG_CLICK_MIN_TIME) buttonState = BUTTON_LONG_CLICK;
+  if (buttonTimer < 0xffff) buttonTimer++;
+  if (wakeupTicks) wakeupTicks--;
+  switch (buttonPhase) {
+    case BUTTON_PRESSED:
+      if (!buttonPressed) {
+        if (buttonTimer <= shortClickTicks) {
+          buttonPhase = BUTTON_IDLE;
+        }
+        else if (doubleClickTicks) {
+          buttonPhase = BUTTON_CLICKED;
+          buttonTimer = 0;
+        }
+        else {
+          queueButtonEvent(EVENT_SHORT_CLICK);
+          buttonPhase = BUTTON_IDLE;
+        }
+      }
+      else if (buttonTimer > longClickTicks) {
+        queueButtonEvent(EVENT_LONG_CLICK);
+        buttonPhase = BUTTON_HELD;
+        buttonTimer = 0;
+      }
+      break;
+    case BUTTON_HELD:
+      if (!buttonPressed) {
+        buttonPhase = BUTTON_IDLE;
+      }
+      else if (buttonTimer >= holdRepeatTicks) {
+        queueButtonEvent(EVENT_HOLD_REPEAT);
+        buttonTimer = 0;
+      }
+      break;
+    case BUTTON_CLICKED:
+      if (buttonPressed) {
+        queueButtonEvent(EVENT_DOUBLE_CLICK);
+        buttonPhase = BUTTON_DOUBLE_PRESSED;
+      }
+      else if (buttonTimer >= doubleClickTicks) {
+        queueButtonEvent(EVENT_SHORT_CLICK);
+        buttonPhase = BUTTON_IDLE;
+      }
+      break;
+    case BUTTON_DOUBLE_PRESSED:
+      if (!buttonPressed) buttonPhase = BUTTON_IDLE;
+      break;
+    default:
+      if (buttonPressed) {
+        buttonPhase = BUTTON_PRESSED;
+        buttonTimer = 0;
+      }
+      break;
   }
-  oldButtonState = currentButtonState;
 }
 
-/// @brief Detects long & short clicks of the rotary encoder button
+/// @brief Called from the tick ISR to queue a button event
+/// @param type Button event type
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+void RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::queueButtonEvent(EventType type) {
+  QueuedEvent event = {(uint8_t)type, counterEpoch, 0};
+  events.push(event);
+}
+
+/// @brief Checks whether any events are waiting to be retrieved
+/// @return True if getEvent() may return an event
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+bool RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::isEventQueued(void) {
+  return (!events.isEmpty());
+}
+
+/// @brief Retrieves the oldest event queued by the interrupt handlers
 ///
-/// If encoder's button short or long click was detected since previous call, this
-/// method returns corresponding RotEnc::ButtonState
+/// Call this method from the main loop only; counter events queued before the last
+/// setCounter() call are discarded
 ///
-/// @return RotEnc::BUTTON_SHORT_CLICK, RotEnc::BUTTON_LONG_CLICK or BUTTON_NONE if
-/// no button click occured since previous call
+/// @param event Receives the event
+/// @return True if event was retrieved or false if no events are queued
 ///
-RotEnc::ButtonState RotEnc::getButtonState(void) {
-  noInterrupts();
-  ButtonState tempState = buttonState;
-  buttonState = BUTTON_NONE;
-  interrupts();
-  return (tempState);
+template <class Port, uint8_t bitA, uint8_t bitB, uint8_t bitBtn, uint8_t cyclesPerDetent>
+bool RotEnc<Port, bitA, bitB, bitBtn, cyclesPerDetent>::getEvent(Event & event) {
+  QueuedEvent queuedEvent;
+  while (events.pop(queuedEvent)) {
+    if ((queuedEvent.type == EVENT_COUNTER) && (queuedEvent.epoch != counterEpoch)) continue;
+    event.type = (EventType)queuedEvent.type;
+    event.counter = queuedEvent.counter;
+    return (true);
+  }
+  return (false);
 }
+
 #endif // #ifndef ROTENC_H
@@ -0,0 +1,52 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "scheduler.h"
+#include "hardware.h"
+
+//////////////////////////////////////////////////////////////////////
+// Scheduler
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises private fields with default values
+Scheduler::Scheduler() {
+  frameAccumulator = 0;
+  frameRunning = false;
+}
+
+/// @brief Sets up and starts the timer
+///
+/// Timer1 is set to normal mode with no prescaler so that it runs freely at CPU clock,
+/// and its Output Compare A interrupt is enabled
+///
+/// On ATtiny85 Timer1 is prescaled and cleared when it reaches OCR1C; OCR1A is set to
+/// the same value so that Output Compare A interrupt occurs once per tick
+///
+/// On ESP8266 timer1 is started in auto-reload mode with tickTicks period
+///
+void Scheduler::begin(void) {
+  noInterrupts();
+#if defined(HW_PROFILE_ESP8266)
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+  timer1_write(tickTicks);
+#elif defined(HW_PROFILE_ATTINY85)
+  TCCR1 = 0;
+  TCNT1 = 0;
+  OCR1A = tickTop;
+  OCR1C = tickTop;
+  TCCR1 = _BV(CTC1) | HW_SCHEDULER_TIMER1_CS;
+  TIFR = _BV(OCF1A);
+  bitSet(TIMSK, OCIE1A);
+#else
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  OCR1A = TCNT1 + tickCycles;
+  TIFR1 = _BV(OCF1A);
+  bitSet(TIMSK1, OCIE1A);
+#endif
+  interrupts();
+}
@@ -0,0 +1,138 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Timer-driven frame scheduler
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#include "hardware.h"
+
+/// @defgroup scheduler Frame Scheduler
+/// @brief Runs frame calculation and transmission at fixed rate
+///
+/// Provides Scheduler class which uses a hardware timer to generate periodic ticks and
+/// to decide when the next frame is due
+///
+/// This module also contains all macros used by Scheduler class as a compile-time settings
+///
+/// @{
+
+/// @brief Generates periodic ticks and frames
+///
+/// Timer1 runs freely at CPU clock, its Output Compare A interrupt is scheduled every
+/// HW_SCHEDULER_TICK_RATE-th of a second; frames are distributed evenly between ticks so
+/// that on average HW_SCHEDULER_FRAME_RATE frames are generated per second
+///
+/// On ATtiny85 Timer1 is 8-bit, so it is prescaled by HW_SCHEDULER_TIMER1_PRESCALER and
+/// cleared on compare match every tick instead
+///
+/// On ESP8266 timer1 reloads itself every tick, its interrupt handler is attached
+/// by the sketch with timer1_attachInterrupt()
+///
+/// Interrupt handler must be called externally from the corresponding ISR; the frame is
+/// calculated and sent with interrupts enabled so that other interrupts are not delayed
+/// by the frame, e.g.:
+/// @code
+/// ISR (HW_SCHEDULER_INTVECT) {
+///   if (!scheduler.tickInterruptHandler()) return;
+///   interrupts();
+///   renderFrame();
+///   noInterrupts();
+///   scheduler.frameComplete();
+/// }
+/// @endcode
+///
+/// Since the frame is rendered with interrupts enabled, tick interrupt may be nested inside
+/// the frame; tickInterruptHandler() is the reentrancy guard: while the frame is running it
+/// only counts the tick and returns false, so the nested handler returns without rendering.
+/// If the frame takes longer than a frame period, next frames are skipped until the
+/// frame is complete
+///
+class Scheduler {
+  public:
+    Scheduler();
+    void begin(void);
+  public:
+    inline bool tickInterruptHandler(void);
+    inline void frameComplete(void);
+  private:
+#if defined(HW_PROFILE_ESP8266)
+    static const uint32_t tickTicks = HW_SCHEDULER_TIMER1_CLOCK / HW_SCHEDULER_TICK_RATE; ///< timer1 ticks per scheduler tick
+#elif defined(HW_PROFILE_ATTINY85)
+    static const uint8_t tickTop = F_CPU / HW_SCHEDULER_TIMER1_PRESCALER / HW_SCHEDULER_TICK_RATE - 1; ///< Timer1 value cleared on compare match
+#else
+    static const uint16_t tickCycles = F_CPU / HW_SCHEDULER_TICK_RATE; ///< Timer1 cycles per tick
+    static const uint16_t tickMargin = 64;  ///< Minimum distance of the next compare match ahead of Timer1, covers the time to write OCR1A
+#endif
+  private:
+    uint16_t frameAccumulator;  ///< Accumulates frame rate every tick, frame is due when tick rate is reached
+    volatile bool frameRunning; ///< True while the frame is being calculated and sent, set and cleared with interrupts disabled
+};
+
+/// @}
+
+#if defined(HW_PROFILE_ESP8266)
+#if (HW_SCHEDULER_TIMER1_CLOCK / HW_SCHEDULER_TICK_RATE) > 8388607L
+#error "HW_SCHEDULER_TICK_RATE is too low for ESP8266 timer1"
+#endif
+#elif defined(HW_PROFILE_ATTINY85)
+#if (F_CPU / HW_SCHEDULER_TIMER1_PRESCALER / HW_SCHEDULER_TICK_RATE) > 256
+#error "HW_SCHEDULER_TICK_RATE is too low for this F_CPU and HW_SCHEDULER_TIMER1_PRESCALER"
+#endif
+#elif (F_CPU / HW_SCHEDULER_TICK_RATE) > 65535
+#error "HW_SCHEDULER_TICK_RATE is too low for this F_CPU"
+#endif
+
+#if HW_SCHEDULER_FRAME_RATE > HW_SCHEDULER_TICK_RATE
+#error "HW_SCHEDULER_FRAME_RATE must not exceed HW_SCHEDULER_TICK_RATE"
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Scheduler inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Call this method from the corresponding ISR with interrupts disabled
+///
+/// Schedules the next tick and checks whether new frame is due
+///
+/// Tick interrupt may be serviced late, e.g. when it was masked while the frame was sent
+/// (see TransmitInterruptMask); if the next compare match would not be ahead of Timer1,
+/// the missed ticks are skipped, otherwise the compare match would only occur after
+/// Timer1 wraps around and all ticks of a Timer1 period would be lost. Ticks can only be
+/// recovered this way if the interrupt is not delayed for a whole Timer1 period (65536
+/// CPU cycles). On ATtiny85 Timer1 is cleared by the compare match and on ESP8266 timer1
+/// reloads itself, so late ticks need no correction there
+///
+/// @return True if new frame must be calculated and sent now, in this case
+/// frameComplete() must be called when the frame is complete; false if no frame is due
+/// or the previous frame is still running (nested tick interrupt)
+bool Scheduler::tickInterruptHandler(void) {
+#if !defined(HW_PROFILE_ATTINY85) && !defined(HW_PROFILE_ESP8266)
+  uint16_t late = TCNT1 - OCR1A;  // Cycles since the compare match of this tick
+  uint32_t ahead = tickCycles;    // Next compare match relative to this one
+  while (ahead < (uint32_t)late + tickMargin) ahead += tickCycles;
+  OCR1A += (uint16_t)ahead;
+#endif
+  frameAccumulator += HW_SCHEDULER_FRAME_RATE;
+  if (frameAccumulator < HW_SCHEDULER_TICK_RATE) return (false);
+  frameAccumulator -= HW_SCHEDULER_TICK_RATE;
+  if (frameRunning) return (false);
+  frameRunning = true;
+  return (true);
+}
+
+/// @brief Call this method from the corresponding ISR with interrupts disabled when
+/// the frame is complete
+void Scheduler::frameComplete(void) {
+  frameRunning = false;
+}
+
+#endif // #ifndef SCHEDULER_H
@@ -0,0 +1,152 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "hardware.h"
+
+#ifdef HW_PROFILE_ESP8266
+#include <EEPROM.h>
+#else
+#include <avr/eeprom.h>
+#endif
+
+#include "storage.h"
+
+//////////////////////////////////////////////////////////////////////
+// Storage
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises private fields with default values
+Storage::Storage() {
+  memset(&lastSlot, 0, sizeof(lastSlot));
+  lastIndex = HW_STORAGE_SLOTS - 1;
+  memset(&pendingState, 0, sizeof(pendingState));
+  pending = false;
+  changeTime = 0;
+}
+
+/// @brief Finds the latest slot in EEPROM and reads lamp state from it
+///
+/// Slots are read once in order; the latest slot is a valid slot which is not followed
+/// (cyclically) by a valid slot with the next sequence number
+///
+/// On ESP8266 EEPROM is emulated in a flash sector which is copied to RAM here
+///
+/// @param state Receives stored lamp state, not modified if nothing is stored
+/// @return True if state was read or false if EEPROM contains no valid slots
+///
+bool Storage::begin(LampState & state) {
+#ifdef HW_PROFILE_ESP8266
+  EEPROM.begin(HW_STORAGE_ADDRESS + HW_STORAGE_SLOTS * sizeof(Slot));
+#else
+  static_assert(HW_STORAGE_ADDRESS + HW_STORAGE_SLOTS * sizeof(Slot) <= E2END + 1, "Storage slots do not fit in EEPROM");
+#endif
+  Slot firstSlot, previousSlot, slot;
+  bool firstValid = false, previousValid = false, found = false;
+  for (uint8_t i = 0; i < HW_STORAGE_SLOTS; i++) {
+    bool valid = readSlot(i, slot);
+    if (!i) {
+      firstSlot = slot;
+      firstValid = valid;
+    }
+    else if (!found && previousValid && (!valid || (slot.sequence != (uint8_t)(previousSlot.sequence + 1)))) {
+      lastSlot = previousSlot;
+      lastIndex = i - 1;
+      found = true;
+    }
+    previousSlot = slot;
+    previousValid = valid;
+  }
+  if (!found && previousValid && (!firstValid || (firstSlot.sequence != (uint8_t)(previousSlot.sequence + 1)))) {
+    lastSlot = previousSlot;
+    lastIndex = HW_STORAGE_SLOTS - 1;
+    found = true;
+  }
+  if (!found) return (false);
+  state = lastSlot.state;
+  return (true);
+}
+
+/// @brief Schedules lamp state to be written when it stops changing
+///
+/// If the state equals to the one stored in EEPROM, the pending write is cancelled
+///
+/// @param state Lamp state to store
+///
+void Storage::save(const LampState & state) {
+  pendingState = state;
+  pending = (memcmp(&state, &lastSlot.state, sizeof(state)) != 0);
+  changeTime = millis();
+}
+
+/// @brief Writes pending state if it was not changed for HW_STORAGE_IDLE_TIME
+///
+/// Call this method from the main loop
+///
+void Storage::update(void) {
+  if (pending && ((millis() - changeTime) >= HW_STORAGE_IDLE_TIME)) write();
+}
+
+/// @brief Writes pending state immediately
+///
+/// Call this method before entering sleep mode where millis() is stopped
+///
+void Storage::flush(void) {
+  if (pending) write();
+}
+
+/// @brief Writes pending state to the slot next to the latest one
+///
+/// On ESP8266 the whole emulated EEPROM sector is rewritten; interrupts stay enabled
+/// (WiFi and timers must keep running during the erase), so interrupt handlers and tables
+/// they read are kept in RAM (ICACHE_RAM_ATTR, HAL_ISR_PROGMEM) because flash is not
+/// accessible while it is being written
+///
+void Storage::write(void) {
+  Slot slot;
+  slot.sequence = lastSlot.sequence + 1;
+  slot.state = pendingState;
+  slot.checksum = calcChecksum(slot);
+  uint8_t index = lastIndex + 1;
+  if (index >= HW_STORAGE_SLOTS) index = 0;
+#ifdef HW_PROFILE_ESP8266
+  EEPROM.put(HW_STORAGE_ADDRESS + index * sizeof(Slot), slot);
+  EEPROM.commit();
+#else
+  eeprom_update_block(&slot, (void *)(HW_STORAGE_ADDRESS + index * sizeof(Slot)), sizeof(Slot));
+#endif
+  lastSlot = slot;
+  lastIndex = index;
+  pending = false;
+}
+
+/// @brief Reads slot and checks its integrity
+/// @param index Slot index in range 0..HW_STORAGE_SLOTS-1
+/// @param slot Receives slot contents
+/// @return True if slot checksum is valid
+bool Storage::readSlot(uint8_t index, Slot & slot) {
+#ifdef HW_PROFILE_ESP8266
+  EEPROM.get(HW_STORAGE_ADDRESS + index * sizeof(Slot), slot);
+#else
+  eeprom_read_block(&slot, (const void *)(HW_STORAGE_ADDRESS + index * sizeof(Slot)), sizeof(Slot));
+#endif
+  return (slot.checksum == calcChecksum(slot));
+}
+
+/// @brief Calculates slot checksum
+///
+/// Checksum is inverted sum of all bytes so that neither erased (all 0xFF) nor zeroed
+/// slot is valid
+///
+/// @param slot Slot to calculate checksum for
+/// @return Checksum of sequence number and state
+uint8_t Storage::calcChecksum(const Slot & slot) {
+  const uint8_t * data = (const uint8_t *)&slot;
+  uint8_t sum = 0;
+  for (uint8_t i = 0; i < sizeof(Slot) - 1; i++)
+    sum += data[i];
+  return (~sum);
+}
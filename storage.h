@@ -0,0 +1,80 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Persistent lamp state in EEPROM
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <Arduino.h>
+
+#include "hardware.h"
+
+/// @defgroup storage Persistent Storage
+/// @brief Keeps lamp state in EEPROM across power cycles
+///
+/// Provides Storage class which stores lamp state in a ring of EEPROM slots; each
+/// save goes to the next slot so that EEPROM wear is spread across all slots
+///
+/// This module also contains all macros used by Storage class as a compile-time settings
+///
+/// @{
+
+/// Lamp state kept in EEPROM
+struct LampState {
+  uint8_t hue;          ///< Hue value
+  uint8_t brightness;   ///< Brightness value
+  uint8_t lampOn;       ///< 1 if lamp is on, 0 if lamp is off
+  uint8_t effect;       ///< Animated effect
+  uint8_t direction;    ///< Lit column or 0 for all columns
+};
+
+/// @brief Stores lamp state in a wear-levelled ring of EEPROM slots
+///
+/// Each slot contains sequence number, lamp state and checksum; sequence number is
+/// incremented with every write, so on startup the latest slot is the one which is
+/// not followed by a slot with the next sequence number. A slot which was not
+/// completely written (e.g. power lost during write) fails the checksum and the
+/// previous slot is used instead
+///
+/// save() does not write immediately: the write is deferred until the state has not
+/// changed for HW_STORAGE_IDLE_TIME, so a number of encoder detents results in a
+/// single slot write
+///
+class Storage {
+  public:
+    Storage();
+    bool begin(LampState & state);
+    void save(const LampState & state);
+    void update(void);
+    void flush(void);
+  private:
+    /// EEPROM slot
+    struct Slot {
+      uint8_t sequence;     ///< Incremented with every write
+      LampState state;      ///< Stored lamp state
+      uint8_t checksum;     ///< Checksum of sequence number and state
+    };
+    static uint8_t calcChecksum(const Slot & slot);
+    static bool readSlot(uint8_t index, Slot & slot);
+    void write(void);
+  private:
+    Slot lastSlot;            ///< Contents of the latest slot in EEPROM
+    uint8_t lastIndex;        ///< Index of the latest slot in EEPROM
+    LampState pendingState;   ///< State to write when idle time has passed
+    bool pending;             ///< True if pendingState is not written yet
+    uint32_t changeTime;      ///< Time when pendingState was last changed, milliseconds
+};
+
+/// @}
+
+#if (HW_STORAGE_SLOTS < 2) || (HW_STORAGE_SLOTS > 128)
+#error "HW_STORAGE_SLOTS must be in range 2..128"
+#endif
+
+#endif // #ifndef STORAGE_H
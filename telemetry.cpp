@@ -0,0 +1,90 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+#include "telemetry.h"
+#include "hardware.h"
+
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+
+//////////////////////////////////////////////////////////////////////
+// Telemetry
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises private fields with default values
+Telemetry::Telemetry() {
+  record.id = 0;
+  record.value = 0;
+  position = 0;
+  dropped = 0;
+  written = false;
+  request = TELEMETRY_REQUEST_NONE;
+}
+
+/// @brief Sets up USART0 before use
+///
+/// Enables transmitter and receiver in asynchronous 8N1 mode at HW_TELEMETRY_BAUD with
+/// double speed, the same way as Arduino Serial does
+///
+void Telemetry::begin(void) {
+  static const uint16_t baudSetting = (F_CPU / 4UL / HW_TELEMETRY_BAUD - 1) / 2;
+  UCSR0A = _BV(U2X0);
+  UBRR0H = highByte(baudSetting);
+  UBRR0L = lowByte(baudSetting);
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(TXEN0) | _BV(RXEN0) | _BV(RXCIE0);
+}
+
+/// @brief Queues telemetry record, call this method from the main loop only
+///
+/// Use TELEMETRY() macro instead of calling this method directly, so that records are
+/// filtered by level at compile time
+///
+/// @param id Record id, see TelemetryId
+/// @param value Record value
+/// @return True if record was queued or false if the queue is full and record was dropped
+///
+bool Telemetry::send(uint8_t id, uint16_t value) {
+  Record newRecord;
+  if (dropped) {
+    newRecord.id = TELEMETRY_ID_DROPPED;
+    newRecord.value = dropped;
+    if (records.push(newRecord)) dropped = 0;
+  }
+  newRecord.id = id;
+  newRecord.value = value;
+  if (dropped || !records.push(newRecord)) {
+    if (dropped < 0xffff) dropped++;
+    return (false);
+  }
+  written = true;
+  bitSet(UCSR0B, UDRIE0);
+  return (true);
+}
+
+/// @brief Waits until all queued records are sent
+///
+/// Call this method before entering a sleep mode where UART is stopped
+///
+void Telemetry::flush(void) {
+  if (!written) return;
+  while (!records.isEmpty() || position) {}
+  while (!bitRead(UCSR0A, TXC0)) {}
+}
+
+/// @brief Retrieves the last request received from the host
+/// @return Received request or TELEMETRY_REQUEST_NONE if nothing was received since
+/// the previous call
+TelemetryRequest Telemetry::getRequest(void) {
+  uint8_t oldSREG = SREG;
+  noInterrupts();
+  uint8_t receivedRequest = request;
+  request = TELEMETRY_REQUEST_NONE;
+  SREG = oldSREG;
+  return ((TelemetryRequest)receivedRequest);
+}
+
+#endif
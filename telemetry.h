@@ -0,0 +1,186 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Asynchronous binary debug telemetry over the serial port
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+#include "hardware.h"
+#include "ringbuf.h"
+
+/// @defgroup telemetry Telemetry
+/// @brief Compact binary debug output which does not block the firmware
+///
+/// Provides Telemetry class which queues fixed-size records and sends them from the UART
+/// interrupt, and TELEMETRY() macro which filters records by level at compile time
+///
+/// Each record is sent as 5 bytes:
+/// * sync byte 0xA5
+/// * record id, see TelemetryId
+/// * 16-bit value, low byte first
+/// * checksum: XOR of record id and both value bytes
+///
+/// Records are decoded on the host with tools/telemetry_decode.py
+///
+/// This module also contains all macros used by Telemetry class as a compile-time settings
+///
+/// @{
+
+/// Telemetry record id, must match tools/telemetry_decode.py
+enum TelemetryId {
+  TELEMETRY_ID_DROPPED,       ///< Records dropped because the queue was full, value is number of records
+  TELEMETRY_ID_STARTUP,       ///< Firmware started, value is major version in the high byte and minor version in the low byte
+  TELEMETRY_ID_LAMP,          ///< Lamp switched, value is 1 if lamp is on and 0 if lamp is off
+  TELEMETRY_ID_CONTROL,       ///< Parameter controlled by encoder changed, value is ControlParameter
+  TELEMETRY_ID_COUNTER,       ///< Encoder counter changed, value is signed counter
+  TELEMETRY_ID_BUTTON,        ///< Button event, value is RotEncBase::EventType
+  TELEMETRY_ID_HUE,           ///< Hue, value is hue
+  TELEMETRY_ID_RED_GREEN,     ///< Calculated colour, value is red component in the low byte and green in the high byte
+  TELEMETRY_ID_BLUE,          ///< Calculated colour, value is blue component
+  TELEMETRY_ID_BRIGHTNESS,    ///< Brightness, value is brightness
+  TELEMETRY_ID_EFFECT,        ///< Effect, value is Effect
+  TELEMETRY_ID_DIRECTION,     ///< Direction, value is lit column or 0 for all columns
+  TELEMETRY_ID_PROFILE_PROBE,   ///< Following profile records refer to this probe, value is ProfileProbe
+  TELEMETRY_ID_PROFILE_COUNT,   ///< Number of measurements since previous dump
+  TELEMETRY_ID_PROFILE_MIN,     ///< Minimum measured time, CPU cycles
+  TELEMETRY_ID_PROFILE_MAX,     ///< Maximum measured time, CPU cycles
+  TELEMETRY_ID_PROFILE_AVERAGE, ///< Average measured time, CPU cycles
+};
+
+/// Single-byte request sent by the host
+enum TelemetryRequest {
+  TELEMETRY_REQUEST_NONE = 0,       ///< No request received
+  TELEMETRY_REQUEST_PROFILE = 'p',  ///< Send profiler statistics
+};
+
+/// @brief Queues telemetry records and sends them from the UART interrupt
+///
+/// send() is called from the main loop only and never waits for the serial port; if the
+/// queue is full, the record is dropped and the number of dropped records is reported
+/// when there is space again
+///
+/// Single-byte requests from the host are received and retrieved with getRequest()
+///
+/// Interrupt handlers must be called externally from the corresponding ISRs, e.g.:
+/// @code
+/// ISR (HW_TELEMETRY_INTVECT) {
+///   telemetry.interruptHandler();
+/// }
+/// ISR (HW_TELEMETRY_RX_INTVECT) {
+///   telemetry.receiveInterruptHandler();
+/// }
+/// @endcode
+///
+/// Telemetry class uses USART0 directly, thus Arduino Serial must not be used
+///
+class Telemetry {
+  public:
+    Telemetry();
+    void begin(void);
+    bool send(uint8_t id, uint16_t value);
+    void flush(void);
+    TelemetryRequest getRequest(void);
+  public:
+    inline void interruptHandler(void);
+    inline void receiveInterruptHandler(void);
+  private:
+    /// Telemetry record as stored in the queue
+    struct Record {
+      uint8_t id;         ///< Record id, see TelemetryId
+      uint16_t value;     ///< Record value
+    };
+    static const uint8_t syncByte = 0xA5;     ///< First byte of every record
+    static const uint8_t recordSize = 5;      ///< Bytes sent per record
+    static const uint8_t queueSize = 32;      ///< Maximum number of records waiting to be sent
+    RingBuffer<Record, queueSize> records;    ///< Records waiting to be sent
+    Record record;                            ///< Record being sent
+    volatile uint8_t position;                ///< Next byte of the record to send, 0 if no record is being sent
+    uint16_t dropped;                         ///< Records dropped since the last TELEMETRY_ID_DROPPED
+    bool written;                             ///< True if anything was written to the UART
+    volatile uint8_t request;                 ///< Last byte received from the host, see TelemetryRequest
+};
+
+/// @}
+
+#if (defined(HW_PROFILE_ATTINY85) || defined(HW_PROFILE_ESP8266)) && (HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF)
+#error "Telemetry requires ATmega USART which is not available on ATtiny85 and ESP8266"
+#endif
+
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+
+extern Telemetry telemetry;
+
+/// @brief Sends telemetry record if level is enabled by HW_TELEMETRY_LEVEL
+///
+/// Records above HW_TELEMETRY_LEVEL are removed by the compiler, so they take no flash
+/// and no cycles
+///
+/// @param level Record level, HW_TELEMETRY_LEVEL_ERROR, HW_TELEMETRY_LEVEL_INFO or HW_TELEMETRY_LEVEL_DEBUG
+/// @param id Record id, see TelemetryId
+/// @param value Record value
+#define TELEMETRY(level, id, value) do { \
+    if ((level) <= HW_TELEMETRY_LEVEL) telemetry.send((id), (uint16_t)(value)); \
+  } while (0)
+
+#else
+
+#define TELEMETRY(level, id, value) do {} while (0)
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Telemetry inline methods
+//////////////////////////////////////////////////////////////////////
+
+#if HW_TELEMETRY_LEVEL > HW_TELEMETRY_LEVEL_OFF
+
+/// @brief Call this method from the corresponding ISR
+///
+/// Sends the next byte of the current record, takes the next record from the queue when
+/// the current one is sent and disables the interrupt when the queue is empty
+void Telemetry::interruptHandler(void) {
+  uint8_t data;
+  switch (position) {
+    case 0:
+      if (!records.pop(record)) {
+        bitClear(UCSR0B, UDRIE0);
+        return;
+      }
+      data = syncByte;
+      break;
+    case 1:
+      data = record.id;
+      break;
+    case 2:
+      data = lowByte(record.value);
+      break;
+    case 3:
+      data = highByte(record.value);
+      break;
+    default:
+      data = record.id ^ lowByte(record.value) ^ highByte(record.value);
+      break;
+  }
+  if (++position >= recordSize) position = 0;
+  UCSR0A = (UCSR0A & (_BV(U2X0) | _BV(MPCM0))) | _BV(TXC0); // clear transmit complete, error flags are written as 0
+  UDR0 = data;
+}
+
+/// @brief Call this method from the corresponding ISR
+///
+/// Stores the request received from the host
+void Telemetry::receiveInterruptHandler(void) {
+  request = UDR0;
+}
+
+#endif
+
+#endif // #ifndef TELEMETRY_H
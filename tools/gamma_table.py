@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+# All rights reserved
+# This software may be modified and distributed under the terms
+# of the MIT license. See the LICENSE file for details.
+#
+
+"""Generates gamma correction tables for neopixel.cpp from a single curve.
+
+Usage:
+    gamma_table.py [gamma]                     print both tables (default gamma 2.2)
+
+gammaTable is 8-bit: output = 255 * (input / 255) ^ gamma. gammaDitherScale is the
+same curve with 16-bit precision, stored as dither scale (0.16 fixed point less one,
+see Neopixel::ditherFrame()). Non-zero inputs never map to zero in either table, so
+the lowest brightness levels stay lit.
+"""
+
+import sys
+
+DEFAULT_GAMMA = 2.2
+
+
+def curve(value, gamma):
+    return (value / 255.0) ** gamma
+
+
+def gamma_table(gamma):
+    return [0] + [max(1, int(round(255 * curve(i, gamma)))) for i in range(1, 256)]
+
+
+def dither_scale_table(gamma):
+    minimum = int(round(65536 / 255.0))
+    return [0] + [max(minimum, int(round(65536 * curve(i, gamma)))) - 1 for i in range(1, 256)]
+
+
+def format_table(values, width, per_line):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("  " + ", ".join("%*d" % (width, value) for value in values[i:i + per_line]) + ",")
+    lines[-1] = lines[-1][:-1]
+    return "\n".join(lines)
+
+
+def main(argv):
+    gamma = float(argv[1]) if len(argv) > 1 else DEFAULT_GAMMA
+    print("/// @brief Gamma correction table, output = 255 * (input / 255) ^ %g, generated by tools/gamma_table.py" % gamma)
+    print("const uint8_t gammaTable[256] PROGMEM = {")
+    print(format_table(gamma_table(gamma), 3, 16))
+    print("};")
+    print()
+    print("/// @brief Dither scale for each brightness, same curve as gammaTable with 16-bit precision")
+    print("const uint16_t gammaDitherScale[256] PROGMEM = {")
+    print(format_table(dither_scale_table(gamma), 5, 16))
+    print("};")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+# All rights reserved
+# This software may be modified and distributed under the terms
+# of the MIT license. See the LICENSE file for details.
+#
+
+"""Decodes binary telemetry records sent by the lamp firmware (see telemetry.h).
+
+Usage:
+    telemetry_decode.py /dev/ttyUSB0 [baud] [--profile]
+                                               read from serial port (requires pyserial),
+                                               --profile requests profiler statistics
+    telemetry_decode.py capture.bin            read from a captured file
+    telemetry_decode.py -                      read from standard input
+"""
+
+import sys
+
+SYNC_BYTE = 0xA5
+RECORD_SIZE = 5
+DEFAULT_BAUD = 115200
+
+CONTROL_PARAMETERS = ["brightness", "hue", "effect", "direction"]
+EFFECTS = ["none", "rainbow", "breathing", "fire", "twinkle"]
+BUTTON_EVENTS = ["counter", "short click", "long click", "double click", "hold repeat"]
+PROFILE_PROBES = ["transmit", "setUniformColour", "encoder ISR", "calcRGB", "renderFrame"]
+
+REQUEST_PROFILE = b"p"
+
+# Encoder ISR body must fit into the gap between two neopixels (see
+# HW_NEOPIXEL_INTERRUPT_WINDOW): 96 cycles at 16 MHz minus about 20 cycles of the gap's own
+# code and about 45 cycles of interrupt response, register saving and return
+ENCODER_ISR_PROBE = PROFILE_PROBES.index("encoder ISR")
+ENCODER_ISR_GAP_BUDGET = 31
+
+
+def name(names, value):
+    return names[value] if value < len(names) else str(value)
+
+
+def signed(value):
+    return value - 0x10000 if value & 0x8000 else value
+
+
+# Must match TelemetryId in telemetry.h
+RECORDS = [
+    ("dropped", lambda v: "%d records" % v),
+    ("startup", lambda v: "firmware version %d.%d" % (v >> 8, v & 0xff)),
+    ("lamp", lambda v: "on" if v else "off"),
+    ("control", lambda v: name(CONTROL_PARAMETERS, v)),
+    ("counter", lambda v: "%d" % signed(v)),
+    ("button", lambda v: name(BUTTON_EVENTS, v)),
+    ("hue", lambda v: "%d" % v),
+    ("red/green", lambda v: "%d / %d" % (v & 0xff, v >> 8)),
+    ("blue", lambda v: "%d" % v),
+    ("brightness", lambda v: "%d" % v),
+    ("effect", lambda v: name(EFFECTS, v)),
+    ("direction", lambda v: "all columns" if not v else "column %d" % v),
+    ("profile probe", lambda v: name(PROFILE_PROBES, v)),
+    ("profile count", lambda v: "%d" % v),
+    ("profile min", lambda v: "%d cycles" % v),
+    ("profile max", lambda v: "%d cycles" % v),
+    ("profile average", lambda v: "%d cycles" % v),
+]
+
+
+def decode_record(record_id, value):
+    if record_id < len(RECORDS):
+        record_name, formatter = RECORDS[record_id]
+        return "%s: %s" % (record_name, formatter(value))
+    return "unknown record %d: 0x%04x" % (record_id, value)
+
+
+def check_gap_budget(probe, record_id, value):
+    """Returns warning if the maximum time of encoder ISR does not fit into the gap."""
+    if probe != ENCODER_ISR_PROBE or RECORDS[record_id][0] != "profile max":
+        return ""
+    if value <= ENCODER_ISR_GAP_BUDGET:
+        return ""
+    return " (exceeds %d cycles, frames may be latched early)" % ENCODER_ISR_GAP_BUDGET
+
+
+def decode(read):
+    """Reads bytes with read() and prints decoded records, resynchronises on errors."""
+    buffer = bytearray()
+    probe = None
+    while True:
+        data = read()
+        if not data:
+            return
+        buffer.extend(data)
+        while len(buffer) >= RECORD_SIZE:
+            if buffer[0] != SYNC_BYTE:
+                del buffer[0]
+                continue
+            record_id, low, high, checksum = buffer[1:RECORD_SIZE]
+            if record_id ^ low ^ high != checksum:
+                print("checksum error, resynchronising", file=sys.stderr)
+                del buffer[0]
+                continue
+            del buffer[:RECORD_SIZE]
+            value = low | (high << 8)
+            warning = ""
+            if record_id < len(RECORDS):
+                if RECORDS[record_id][0] == "profile probe":
+                    probe = value
+                warning = check_gap_budget(probe, record_id, value)
+            print(decode_record(record_id, value) + warning, flush=True)
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__, file=sys.stderr)
+        return 1
+    profile = "--profile" in argv
+    argv = [arg for arg in argv if arg != "--profile"]
+    source = argv[1]
+    if source == "-":
+        decode(lambda: sys.stdin.buffer.read1(64))
+    elif source.startswith("/dev/") or source.upper().startswith("COM"):
+        import serial
+        baud = int(argv[2]) if len(argv) > 2 else DEFAULT_BAUD
+        with serial.Serial(source, baud) as port:
+            if profile:
+                port.write(REQUEST_PROFILE)
+            decode(lambda: port.read(max(1, port.in_waiting)))
+    else:
+        with open(source, "rb") as capture:
+            decode(lambda: capture.read(64))
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main(sys.argv))
+    except KeyboardInterrupt:
+        sys.exit(0)
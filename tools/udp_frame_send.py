@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+# All rights reserved
+# This software may be modified and distributed under the terms
+# of the MIT license. See the LICENSE file for details.
+#
+
+"""Sends neopixel colours to the ESP8266 lamp over UDP (see network.h).
+
+Usage:
+    udp_frame_send.py host colour [colour ...] [--first N] [--count C] [--timeout S]
+                                               send neopixels starting from index N
+                                               (default 0); colours are RRGGBB hex,
+                                               the last colour is repeated up to C
+                                               neopixels; timeout is in seconds
+                                               (default 5, 255 = forever)
+    udp_frame_send.py host --release           hand neopixels back to the lamp
+"""
+
+import socket
+import struct
+import sys
+
+PROTOCOL_ID = ord("G")
+DEFAULT_PORT = 21324
+DEFAULT_TIMEOUT = 5
+
+
+def option(argv, flag, default):
+    if flag not in argv:
+        return default
+    index = argv.index(flag)
+    value = int(argv[index + 1])
+    del argv[index:index + 2]
+    return value
+
+
+def packet(first, timeout, colours):
+    data = bytearray(struct.pack(">BBH", PROTOCOL_ID, timeout, first))
+    for colour in colours:
+        r, g, b = (colour >> 16) & 0xFF, (colour >> 8) & 0xFF, colour & 0xFF
+        data += bytes((g, r, b))
+    return bytes(data)
+
+
+def main(argv):
+    argv = list(argv)
+    release = "--release" in argv
+    argv = [arg for arg in argv if arg != "--release"]
+    first = option(argv, "--first", 0)
+    timeout = option(argv, "--timeout", DEFAULT_TIMEOUT)
+    count = option(argv, "--count", 0)
+    if len(argv) < 2 or (not release and len(argv) < 3):
+        print(__doc__, file=sys.stderr)
+        return 1
+    colours = [int(colour, 16) for colour in argv[2:]]
+    if colours and count > len(colours):
+        colours += [colours[-1]] * (count - len(colours))
+    if release:
+        data = packet(0, 0, [])
+    else:
+        data = packet(first, timeout, colours)
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.sendto(data, (argv[1], DEFAULT_PORT))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,131 @@
+/*
+* Copyright (C) 2017 Nick Naumenko (https://github.com/nnaumenko)
+* All rights reserved
+* This software may be modified and distributed under the terms
+* of the MIT license. See the LICENSE file for details.
+*/
+
+/// @file
+/// @brief Smooth transitions between colour states
+
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include "hal.h"
+
+/// @defgroup transition Transitions
+/// @brief Linear interpolation of 8-bit values over a number of frames
+///
+/// Provides Transition class template which moves a set of 8-bit values (e.g. RGB
+/// components and brightness) from their current state to the target in a given number
+/// of frames
+///
+/// @{
+
+/// @brief Interpolates a set of 8-bit channels towards the target values
+///
+/// Values are stored as 8.8 fixed-point; per-frame delta of each channel is calculated
+/// once when transition is started, so that step() only adds the delta and no
+/// division is performed per frame. On the last frame the values are set exactly to
+/// the target
+///
+/// start() is called from the main loop, step() is called from the frame scheduler;
+/// step() does not touch the values while the transition is being restarted
+///
+/// @tparam channels Number of interpolated values
+template <uint8_t channels>
+class Transition {
+  public:
+    Transition();
+    inline void start(const uint8_t newTarget[], uint8_t frames);
+    inline void set(const uint8_t newTarget[]);
+    inline bool step(void);
+    inline bool isRunning(void);
+    inline uint8_t value(uint8_t channel);
+  private:
+    uint16_t current[channels];   ///< Current value of each channel, 8.8 fixed-point
+    int16_t delta[channels];      ///< Added to current value every frame, 8.8 fixed-point
+    uint8_t target[channels];     ///< Target value of each channel
+    volatile uint8_t framesLeft;  ///< Frames left until the target is reached, 0 if transition is not running
+};
+
+/// @}
+
+//////////////////////////////////////////////////////////////////////
+// Transition inline methods
+//////////////////////////////////////////////////////////////////////
+
+/// @brief Initialises all channels to zero, no transition is running
+template <uint8_t channels>
+Transition<channels>::Transition() {
+  for (uint8_t i = 0; i < channels; i++) {
+    current[i] = 0;
+    delta[i] = 0;
+    target[i] = 0;
+  }
+  framesLeft = 0;
+}
+
+/// @brief Starts transition from the current values to the new target
+///
+/// If the previous transition is still running, the new one starts from the values
+/// reached so far
+///
+/// @param newTarget Target values for all channels
+/// @param frames Number of frames the transition takes, 0 or 1 means the target is set
+/// on the next frame
+template <uint8_t channels>
+void Transition<channels>::start(const uint8_t newTarget[], uint8_t frames) {
+  framesLeft = 0;
+  if (!frames) frames = 1;
+  for (uint8_t i = 0; i < channels; i++) {
+    target[i] = newTarget[i];
+    delta[i] = (((int32_t)newTarget[i] << 8) - current[i]) / frames;
+  }
+  framesLeft = frames;
+}
+
+/// @brief Sets all channels to the new values immediately, running transition is stopped
+/// @param newTarget New values for all channels
+template <uint8_t channels>
+void Transition<channels>::set(const uint8_t newTarget[]) {
+  framesLeft = 0;
+  for (uint8_t i = 0; i < channels; i++) {
+    target[i] = newTarget[i];
+    current[i] = (uint16_t)newTarget[i] << 8;
+  }
+}
+
+/// @brief Advances transition by one frame, call this method once per frame
+///
+/// @return True if values were changed by this frame, false if transition is not running
+template <uint8_t channels>
+bool Transition<channels>::step(void) {
+  if (!framesLeft) return (false);
+  if (--framesLeft) {
+    for (uint8_t i = 0; i < channels; i++)
+      current[i] += delta[i];
+  }
+  else {
+    for (uint8_t i = 0; i < channels; i++)
+      current[i] = (uint16_t)target[i] << 8;
+  }
+  return (true);
+}
+
+/// @brief Checks whether transition is still running
+/// @return True if target is not reached yet
+template <uint8_t channels>
+bool Transition<channels>::isRunning(void) {
+  return (framesLeft != 0);
+}
+
+/// @brief Returns value of a channel reached by the transition
+/// @param channel Channel number in range 0..channels-1
+/// @return Current value of the channel
+template <uint8_t channels>
+uint8_t Transition<channels>::value(uint8_t channel) {
+  return (current[channel] >> 8);
+}
+
+#endif // #ifndef TRANSITION_H